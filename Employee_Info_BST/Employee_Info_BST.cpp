@@ -30,26 +30,184 @@ Then, print the menu for users to choose from.
 The implementation of the BST is a modification of the code found here:
 https://gist.github.com/harish-r/a7df7ce576dda35c9660
 */
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <random>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// SIMD key search (see KeySearch) is only compiled for x86 targets.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define EMPLOYEE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define EMPLOYEE_X86 0
+#endif
+
+// gcc and clang only emit vector instructions in functions marked for them
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
 using namespace std;
 
+/* Interns strings into one table shared by the whole program, so equal
+strings are stored once and referred to by a 32-bit id. The characters
+live back to back in large blocks instead of one heap block per string.
+Ids are never reclaimed; the table only grows. */
+class StringPool {
+    static constexpr size_t blockSize = 1 << 20;
+    static constexpr size_t chunkSize = 1 << 16;  // ids per chunk of the id table
+
+    vector<unique_ptr<char[]>> blocks;
+    size_t blockUsed = 0;
+    // id -> characters. The chunk list is reserved up front and chunks never
+    // move, so view() can read any id it was handed without taking the lock.
+    vector<unique_ptr<string_view[]>> chunks;
+    uint32_t count = 0;
+    size_t bytes = 0;
+    unordered_map<string_view, uint32_t> ids;
+    mutex lock;
+
+    StringPool() {
+        chunks.reserve((size_t(UINT32_MAX) + 1) / chunkSize);
+        intern("");     // id 0 is the empty string
+    }
+
+    // Copies s into the character blocks and returns the stored copy.
+    string_view store(string_view s) {
+        if (blocks.empty() || s.size() > blockSize - blockUsed) {
+            blocks.emplace_back(new char[max(blockSize, s.size())]);
+            blockUsed = 0;
+            bytes += max(blockSize, s.size());
+        }
+        char* p = blocks.back().get() + blockUsed;
+        copy(s.begin(), s.end(), p);
+        blockUsed += s.size();
+        return string_view(p, s.size());
+    }
+
+public:
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    static StringPool& shared() {
+        static StringPool pool;
+        return pool;
+    }
+
+    uint32_t intern(string_view s) {
+        lock_guard<mutex> guard(lock);
+        auto found = ids.find(s);
+        if (found != ids.end()) return found->second;
+        if (count % chunkSize == 0) chunks.emplace_back(new string_view[chunkSize]);
+        string_view stored = store(s);
+        chunks.back()[count % chunkSize] = stored;
+        ids.emplace(stored, count);
+        return count++;
+    }
+
+    // Looks s up without interning it; false if it has never been interned
+    bool find(string_view s, uint32_t& id) {
+        lock_guard<mutex> guard(lock);
+        auto found = ids.find(s);
+        if (found == ids.end()) return false;
+        id = found->second;
+        return true;
+    }
+
+    string_view view(uint32_t id) const {
+        return chunks[id / chunkSize][id % chunkSize];
+    }
+
+    // Number of distinct strings interned so far
+    size_t size() const { return count; }
+
+    // Bytes held for characters, not counting the id table or hash index
+    size_t bytesReserved() const { return bytes; }
+};
+
+/* A 4-byte handle to a string in the shared StringPool. Equal strings
+always get the same id, so equality is a single integer compare. */
+class InternedString {
+    uint32_t index = 0;
+
+public:
+    InternedString() {}
+    InternedString(string_view s) : index(StringPool::shared().intern(s)) {}
+    InternedString(const string& s) : InternedString(string_view(s)) {}
+    InternedString(const char* s) : InternedString(string_view(s)) {}
+
+    uint32_t id() const { return index; }
+    string_view view() const { return StringPool::shared().view(index); }
+    string str() const { return string(view()); }
+    bool empty() const { return index == 0; }
+
+    bool operator==(const InternedString& other) const { return index == other.index; }
+    bool operator!=(const InternedString& other) const { return index != other.index; }
+
+    // Orders by the characters, not by the order strings were interned in
+    bool operator<(const InternedString& other) const { return view() < other.view(); }
+
+    friend ostream& operator<<(ostream& os, const InternedString& obj) {
+        return os << obj.view();
+    }
+};
+
+/* One employee: the salary plus three handles into the shared StringPool,
+16 bytes in all, with no heap blocks of its own. */
 struct Employee {
     Employee() {};
-    Employee(string firstName, string lastName, string jobTitle, int salary) :
+    Employee(InternedString firstName, InternedString lastName, InternedString jobTitle, int salary) :
         firstName(firstName),
         lastName(lastName),
         jobTitle(jobTitle),
         salary(salary) {}
 
     int salary{};
-    string firstName{};
-    string lastName{};
-    string jobTitle{};
+    InternedString firstName{};
+    InternedString lastName{};
+    InternedString jobTitle{};
 
     bool operator<(const Employee& other) const {
         return salary < other.salary;
@@ -74,162 +232,1917 @@ struct Employee {
             && jobTitle == other.jobTitle;
     }
 
-    bool operator!=(const Employee& other) const {
-        return !(*this == other);
+    bool operator!=(const Employee& other) const {
+        return !(*this == other);
+    }
+
+    friend ostream& operator<<(ostream& os, const Employee& obj) {
+        os << obj.firstName << " " << obj.lastName << ", " << obj.jobTitle << " ($" << obj.salary << ")";
+        return os;
+    }
+};
+
+/* A total order on employees: by salary, then by last name, first name
+and job title, comparing their characters. Unlike operator<, it only
+calls two employees equivalent when operator== calls them equal. */
+struct EmployeeKeyLess {
+    bool operator()(const Employee& a, const Employee& b) const {
+        if (a.salary != b.salary) return a.salary < b.salary;
+        if (a.lastName != b.lastName) return a.lastName < b.lastName;
+        if (a.firstName != b.firstName) return a.firstName < b.firstName;
+        return a.jobTitle < b.jobTitle;
+    }
+};
+
+/* A read-only view of a contiguous run of employees, such as every
+employee stored under one salary. */
+struct EmployeeSpan {
+    EmployeeSpan() {}
+    EmployeeSpan(const Employee* first, size_t count) : first(first), count(count) {}
+
+    const Employee* first = nullptr;
+    size_t count = 0;
+
+    const Employee* begin() const { return first; }
+    const Employee* end() const { return first + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const Employee& operator[](size_t i) const { return first[i]; }
+
+    const Employee& at(size_t i) const {
+        if (i >= count) throw out_of_range("EmployeeSpan::at");
+        return first[i];
+    }
+};
+
+/* Allocation counters kept by every NodeAllocator, so the effect of a
+pooling strategy can be measured from the outside. */
+struct AllocatorStats {
+    size_t allocations = 0;         // blocks handed out to the tree
+    size_t deallocations = 0;       // blocks given back by the tree
+    size_t released = 0;            // blocks still in use when release() dropped their slabs
+    size_t systemAllocations = 0;   // calls made to the global operator new
+    size_t bytesReserved = 0;       // bytes currently held from the system
+
+    size_t blocksInUse() const { return allocations - deallocations - released; }
+};
+
+/* Where a tree gets the memory for its nodes. A tree owns its allocator,
+so each tree can pick its own strategy. */
+class NodeAllocator {
+public:
+    virtual ~NodeAllocator() {}
+
+    virtual void* allocate(size_t size) = 0;
+    virtual void deallocate(void* p, size_t size) = 0;
+
+    // Whether release() can drop every block at once, letting the tree
+    // skip handing nodes back one at a time when it is torn down.
+    virtual bool canRelease() const { return false; }
+    virtual void release() {}
+
+    const AllocatorStats& stats() const { return counters; }
+
+protected:
+    AllocatorStats counters;
+};
+
+// One global new/delete per node.
+class HeapAllocator : public NodeAllocator {
+public:
+    void* allocate(size_t size) override {
+        counters.allocations++;
+        counters.systemAllocations++;
+        counters.bytesReserved += size;
+        return ::operator new(size);
+    }
+
+    void deallocate(void* p, size_t size) override {
+        counters.deallocations++;
+        counters.bytesReserved -= size;
+        ::operator delete(p);
+    }
+};
+
+/* Carves nodes out of large slabs and recycles removed nodes through an
+intrusive free list. Every block in a pool has the size of the first
+request, which is fine since a tree only ever allocates one node type. */
+class PoolAllocator : public NodeAllocator {
+    struct freeBlock {
+        freeBlock* next;
+    };
+
+    size_t blocksPerSlab;
+    size_t blockSize = 0;
+    vector<void*> slabs;
+    freeBlock* freeList = nullptr;
+    char* cursor = nullptr;     // next unused block in the newest slab
+    char* limit = nullptr;      // end of the newest slab
+
+public:
+    PoolAllocator(size_t blocksPerSlab = 4096) : blocksPerSlab(blocksPerSlab) {}
+
+    PoolAllocator(const PoolAllocator&) = delete;
+    PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+    ~PoolAllocator() override {
+        release();
+    }
+
+    void* allocate(size_t size) override {
+        if (blockSize == 0) {   // round up so every block stays aligned
+            const size_t align = alignof(max_align_t);
+            blockSize = (max(size, sizeof(freeBlock)) + align - 1) / align * align;
+        }
+        else if (size > blockSize) {
+            throw invalid_argument("PoolAllocator only serves blocks of one size");
+        }
+        counters.allocations++;
+        if (freeList != nullptr) {
+            freeBlock* b = freeList;
+            freeList = b->next;
+            return b;
+        }
+        if (cursor == limit) {
+            size_t bytes = blockSize * blocksPerSlab;
+            cursor = static_cast<char*>(::operator new(bytes));
+            limit = cursor + bytes;
+            slabs.push_back(cursor);
+            counters.systemAllocations++;
+            counters.bytesReserved += bytes;
+        }
+        void* p = cursor;
+        cursor += blockSize;
+        return p;
+    }
+
+    void deallocate(void* p, size_t) override {
+        counters.deallocations++;
+        freeBlock* b = static_cast<freeBlock*>(p);
+        b->next = freeList;
+        freeList = b;
+    }
+
+    bool canRelease() const override { return true; }
+
+    // Hands every slab back to the system, whether or not its blocks were
+    // freed. Blocks the tree never gave back are counted as released, not
+    // as deallocations, so the stats still show how many there were.
+    void release() override {
+        for (void* slab : slabs) ::operator delete(slab);
+        slabs.clear();
+        freeList = nullptr;
+        cursor = limit = nullptr;
+        counters.released += counters.blocksInUse();
+        counters.bytesReserved = 0;
+    }
+};
+
+/* Worker threads shared by the whole program, for splitting one large job,
+such as a bulk build or a full payroll report, across the cores. run()
+hands tasks out through a shared counter, so a thread that finishes early
+takes the next task instead of idling; with several tasks per thread that
+evens out uneven work the way work stealing would, without a queue per
+thread. The calling thread works too. One job runs at a time: a run() that
+finds the pool busy, including one made from inside a task, does all its
+tasks itself. */
+class WorkerPool {
+    vector<thread> workers;
+    size_t active;              // threads that take part in a job, counting the caller
+
+    mutex lock;                 // guards everything below
+    condition_variable wake, done;
+    function<void(size_t)> job;
+    size_t jobTasks = 0;
+    atomic<size_t> nextTask{ 0 };
+    uint64_t generation = 0;    // bumped for every job
+    size_t busy = 0;            // workers still on the current job
+    bool stopping = false;
+    mutex running;              // held by the caller of the job in progress
+
+    WorkerPool(size_t threads) : active(threads) {
+        for (size_t i = 1; i < threads; i++) workers.emplace_back([this, i] { work(i); });
+    }
+
+    // Set on a thread for as long as it runs tasks. std::mutex cannot be
+    // tried by a thread that already holds it, so nested run()s check this.
+    static bool& inTask() {
+        thread_local bool flag = false;
+        return flag;
+    }
+
+    // Takes tasks until there are none left
+    void drain() {
+        for (size_t i = nextTask++; i < jobTasks; i = nextTask++) job(i);
+    }
+
+    void work(size_t index) {
+        inTask() = true;
+        uint64_t seen = 0;
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            guard.unlock();
+            if (index < active) drain();
+            guard.lock();
+            if (--busy == 0) done.notify_one();
+        }
+    }
+
+public:
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& w : workers) w.join();
+    }
+
+    // One thread per core
+    static WorkerPool& shared() {
+        static WorkerPool pool(max(1u, thread::hardware_concurrency()));
+        return pool;
+    }
+
+    // Threads that take part in a job, counting the caller
+    size_t size() const { return active; }
+
+    // Lets only the first threads of the pool take part, e.g. to time a
+    // job on fewer cores. Must not be called while a job is running.
+    void limit(size_t threads) {
+        lock_guard<mutex> guard(running);
+        active = min(max<size_t>(threads, 1), workers.size() + 1);
+    }
+
+    // Calls work(i) for every i in [0, tasks), in any order and on any of
+    // the pool's threads, and returns once every call has.
+    template<typename Work>
+    void run(size_t tasks, Work work) {
+        unique_lock<mutex> exclusive;
+        if (!inTask() && active > 1 && tasks > 1) exclusive = unique_lock<mutex>(running, try_to_lock);
+        if (!exclusive.owns_lock()) {
+            for (size_t i = 0; i < tasks; i++) work(i);
+            return;
+        }
+        unique_lock<mutex> guard(lock);
+        job = work;
+        jobTasks = tasks;
+        nextTask = 0;
+        busy = workers.size();
+        generation++;
+        guard.unlock();
+        wake.notify_all();
+        inTask() = true;
+        drain();
+        inTask() = false;
+        guard.lock();
+        done.wait(guard, [this] { return busy == 0; });
+        job = nullptr;
+    }
+};
+
+/* stable_sort by salary, split across the shared WorkerPool for large
+inputs: each thread sorts a slice, then the slices are merged pairwise,
+every merge itself cut into pieces at matching salaries so the last
+rounds keep all the threads busy too. */
+static void parallelStableSort(vector<Employee>& v) {
+    WorkerPool& pool = WorkerPool::shared();
+    const size_t minParallel = 1 << 16;
+    if (pool.size() == 1 || v.size() < minParallel) {
+        stable_sort(v.begin(), v.end());
+        return;
+    }
+    size_t slices = 1;
+    while (slices < pool.size()) slices *= 2;
+    vector<size_t> bounds(slices + 1);
+    for (size_t i = 0; i <= slices; i++) bounds[i] = v.size() * i / slices;
+    pool.run(slices, [&](size_t i) { stable_sort(v.begin() + bounds[i], v.begin() + bounds[i + 1]); });
+
+    vector<Employee> buffer(v.size());
+    vector<Employee>* from = &v;
+    vector<Employee>* to = &buffer;
+    for (size_t width = 1; width < slices; width *= 2) {
+        size_t pairs = slices / (2 * width);
+        size_t pieces = max<size_t>(1, 4 * pool.size() / pairs);
+        pool.run(pairs * pieces, [&](size_t task) {
+            size_t pair = task / pieces, piece = task % pieces;
+            size_t lo = bounds[2 * width * pair], mid = bounds[2 * width * pair + width], hi = bounds[2 * width * (pair + 1)];
+            auto a = from->begin();
+            // Piece boundaries in the left run, and where the right run splits to match.
+            // Right-run ties go after left-run ones, as stable_sort would order them.
+            size_t a0 = lo + (mid - lo) * piece / pieces;
+            size_t a1 = lo + (mid - lo) * (piece + 1) / pieces;
+            size_t b0 = piece == 0 ? mid : size_t(std::lower_bound(a + mid, a + hi, a[a0]) - a);
+            size_t b1 = piece + 1 == pieces ? hi : size_t(std::lower_bound(a + mid, a + hi, a[a1]) - a);
+            merge(a + a0, a + a1, a + b0, a + b1, to->begin() + a0 + (b0 - mid));
+        });
+        swap(from, to);
+    }
+    if (from != &v) v.swap(buffer);
+}
+
+/* A secondary index on one name field of the employees in a tree, so
+finding everyone named Smith does not mean scanning the whole roster. It
+stores no employees, only the salary each one is filed under, which is
+the tree's own key: a lookup collects the salaries here and then reads the
+matching employees out of those buckets. Names are already interned, so
+exact matches go through a hash on the InternedString id; prefix queries
+walk the distinct names, kept sorted by their characters. The tree that
+owns the index keeps it up to date on every insert and remove.
+
+A common name or title is filed under thousands of salaries, too many to
+search on every remove. A remove only notes the salary, and once a name
+has half as many noted as filed, both lists are sorted and the noted ones
+taken out in one pass: O(log n) per remove, amortized. Until then a
+lookup may visit a salary nobody with the name earns any more, which
+reading the bucket weeds out. */
+class NameIndex {
+public:
+    enum field { firstName, lastName, jobTitle };
+
+    static InternedString key(const Employee& e, field f) {
+        switch (f) {
+        case firstName: return e.firstName;
+        case lastName: return e.lastName;
+        default: return e.jobTitle;
+        }
+    }
+
+    NameIndex(field indexed) : indexed(indexed) {}
+
+    field which() const { return indexed; }
+
+    void add(const Employee& e) {
+        InternedString name = key(e, indexed);
+        posting& entry = postings[name.id()];
+        if (entry.filed.empty()) names.emplace(name.view(), name.id());
+        entry.filed.push_back(e.salary);
+    }
+
+    void remove(const Employee& e) {
+        InternedString name = key(e, indexed);
+        auto found = postings.find(name.id());
+        if (found == postings.end()) return;
+        posting& entry = found->second;
+        entry.dropped.push_back(e.salary);
+        if (entry.dropped.size() * 2 < entry.filed.size()) return;
+        sort(entry.filed.begin(), entry.filed.end());
+        sort(entry.dropped.begin(), entry.dropped.end());
+        vector<int> kept;
+        set_difference(entry.filed.begin(), entry.filed.end(), entry.dropped.begin(), entry.dropped.end(), back_inserter(kept));
+        entry.filed.swap(kept);
+        entry.dropped.clear();
+        if (!entry.filed.empty()) return;
+        names.erase(name.view());
+        postings.erase(found);
+    }
+
+    void clear() {
+        postings.clear();
+        names.clear();
+    }
+
+    // Ids of the stored names that start with prefix, in order
+    vector<uint32_t> withPrefix(string_view prefix) const {
+        vector<uint32_t> out;
+        for (auto it = names.lower_bound(prefix); it != names.end() && it->first.substr(0, prefix.size()) == prefix; ++it) {
+            out.push_back(it->second);
+        }
+        return out;
+    }
+
+    // Every salary an employee with one of these name ids is filed under,
+    // ascending, once each, and perhaps a few they were filed under before
+    vector<int> salaries(const vector<uint32_t>& ids) const {
+        vector<int> out;
+        for (uint32_t id : ids) {
+            auto found = postings.find(id);
+            if (found != postings.end()) out.insert(out.end(), found->second.filed.begin(), found->second.filed.end());
+        }
+        sort(out.begin(), out.end());
+        out.erase(unique(out.begin(), out.end()), out.end());
+        return out;
+    }
+
+private:
+    // The salaries filed under one name, one per employee added, and those
+    // of the employees removed since the list was last compacted
+    struct posting {
+        vector<int> filed;
+        vector<int> dropped;
+    };
+
+    field indexed;
+    unordered_map<uint32_t, posting> postings;      // by name id
+    map<string_view, uint32_t> names;               // every name in postings, by its characters
+};
+
+class EmployeeBST {
+public:
+    /* How employees who earn the same salary are ordered in their bucket.
+    keyOrder keeps every bucket sorted by EmployeeKeyLess, so findAll lists
+    ties the same way whatever order they arrived in, and remove finds one
+    employee by binary search instead of comparing it against every tie. */
+    enum tieOrder { insertionOrder, keyOrder };
+
+private:
+    /* Salaries repeat a lot, so each node is one distinct salary holding
+    the bucket of every employee who earns it, in insertion order. */
+    struct node {
+        node(Employee&& data) : salary(data.salary), left(nullptr), right(nullptr) {
+            employees.push_back(std::move(data));
+        }
+
+        int salary;
+        vector<Employee> employees;
+        node* left;
+        node* right;
+    };
+
+    node* root;
+    unique_ptr<NodeAllocator> allocator;
+    tieOrder ties = insertionOrder;
+
+    // Moves [first, last) into the end of bucket, then into place under keyOrder
+    void addToBucket(vector<Employee>& bucket, Employee* first, Employee* last) {
+        size_t old = bucket.size();
+        bucket.insert(bucket.end(), make_move_iterator(first), make_move_iterator(last));
+        if (ties == insertionOrder) return;
+        auto end = bucket.begin() + old;
+        if (bucket.size() == old + 1) {
+            rotate(std::upper_bound(bucket.begin(), end, bucket.back(), EmployeeKeyLess()), end, bucket.end());
+        }
+        else {
+            sort(end, bucket.end(), EmployeeKeyLess());
+            inplace_merge(bucket.begin(), end, bucket.end(), EmployeeKeyLess());
+        }
+    }
+
+    // Where e itself is in bucket, or bucket.end() if it is not there
+    vector<Employee>::iterator findInBucket(vector<Employee>& bucket, const Employee& e) {
+        if (ties == insertionOrder) return std::find(bucket.begin(), bucket.end(), e);
+        auto it = std::lower_bound(bucket.begin(), bucket.end(), e, EmployeeKeyLess());
+        return it != bucket.end() && *it == e ? it : bucket.end();
+    }
+
+    // Takes one copy of each of [first, last) out of bucket, keeping the
+    // rest in order, and returns how many it found.
+    size_t takeFromBucket(vector<Employee>& bucket, const Employee* first, const Employee* last) {
+        if (last - first == 1) {
+            auto it = findInBucket(bucket, *first);
+            if (it == bucket.end()) return 0;
+            removeFromIndexes(*it);
+            bucket.erase(it);
+            return 1;
+        }
+        vector<Employee> targets(first, last);
+        sort(targets.begin(), targets.end(), EmployeeKeyLess());
+        vector<size_t> taken(targets.size(), 0);    // for each run of equal targets, at its first index
+        size_t before = bucket.size();
+        bucket.erase(remove_if(bucket.begin(), bucket.end(), [&](const Employee& e) {
+            auto match = std::equal_range(targets.begin(), targets.end(), e, EmployeeKeyLess());
+            size_t at = size_t(match.first - targets.begin());
+            if (match.first == match.second || taken[at] == size_t(match.second - match.first)) return false;
+            taken[at]++;
+            removeFromIndexes(e);
+            return true;
+        }), bucket.end());
+        return before - bucket.size();
+    }
+
+    // Sorts each run of one salary in sorted, starting at runs[i], by EmployeeKeyLess
+    static void sortRuns(vector<Employee>& sorted, const vector<size_t>& runs) {
+        size_t distinct = runs.size() - 1;
+        WorkerPool& pool = WorkerPool::shared();
+        size_t slices = sorted.size() < (1 << 16) ? 1 : 4 * pool.size();
+        pool.run(slices, [&](size_t slice) {
+            for (size_t i = distinct * slice / slices; i < distinct * (slice + 1) / slices; i++) {
+                sort(sorted.begin() + runs[i], sorted.begin() + runs[i + 1], EmployeeKeyLess());
+            }
+        });
+    }
+
+    unique_ptr<NameIndex> nameIndexes[3];   // by NameIndex::field, only for the fields indexed
+
+    void addToIndexes(const Employee& e) {
+        for (unique_ptr<NameIndex>& index : nameIndexes) {
+            if (index) index->add(e);
+        }
+    }
+
+    void removeFromIndexes(const Employee& e) {
+        for (unique_ptr<NameIndex>& index : nameIndexes) {
+            if (index) index->remove(e);
+        }
+    }
+
+    // The employees whose indexed field has one of ids, read out of the
+    // buckets of the salaries index lists for them, in salary order.
+    vector<Employee> lookup(const NameIndex& index, vector<uint32_t> ids) {
+        vector<Employee> out;
+        sort(ids.begin(), ids.end());
+        for (int salary : index.salaries(ids)) {
+            for (const Employee& e : findAll(salary)) {
+                if (binary_search(ids.begin(), ids.end(), NameIndex::key(e, index.which()).id())) out.push_back(e);
+            }
+        }
+        return out;
+    }
+
+    node* createNode(Employee&& x) {
+        return new (allocator->allocate(sizeof(node))) node(std::move(x));
+    }
+
+    void destroyNode(node* t) {
+        t->~node();
+        allocator->deallocate(t, sizeof(node));
+    }
+
+    /* Destroys every node under t. Blocks are only handed back one by one
+    when giveBack is set; otherwise the caller releases the whole pool.
+    Rotating each left child up before freeing a node keeps this iterative
+    without needing a stack, even on a degenerate tree. */
+    node* makeEmpty(node* t, bool giveBack = true) {
+        while (t != nullptr) {
+            if (t->left != nullptr) {
+                node* l = t->left;
+                t->left = l->right;
+                l->right = t;
+                t = l;
+            }
+            else {
+                node* r = t->right;
+                t->~node();
+                if (giveBack) allocator->deallocate(t, sizeof(node));
+                t = r;
+            }
+        }
+        return nullptr;
+    }
+
+    // Returns the link (child pointer, or the subtree root itself) that
+    // holds salary x, or the null link where a node for x would go.
+    node** findLink(int x, node** link) {
+        while (*link != nullptr && (*link)->salary != x) {
+            link = (x < (*link)->salary) ? &(*link)->left : &(*link)->right;
+        }
+        return link;
+    }
+
+    // Adds [first, last), who all earn the same salary, with one descent.
+    // They are only moved from once their node has been found.
+    void insertRun(Employee* first, Employee* last) {
+        for (Employee* e = first; e != last; ++e) addToIndexes(*e);
+        node** link = findLink(first->salary, &root);
+        if (*link == nullptr) *link = createNode(std::move(*first++));
+        addToBucket((*link)->employees, first, last);
+    }
+
+    // Removes one copy of each of [first, last), who all earn the same
+    // salary, with one descent, and returns how many were stored.
+    size_t removeRun(const Employee* first, const Employee* last) {
+        node* t = find(root, first->salary);
+        if (t == nullptr) return 0;
+        size_t removed = takeFromBucket(t->employees, first, last);
+        if (t->employees.empty()) root = remove(t->salary, root);
+        return removed;
+    }
+
+    node* findMin(node* t) {
+        if (t == nullptr) return nullptr;
+        while (t->left != nullptr) t = t->left;
+        return t;
+    }
+
+    node* findMax(node* t) {
+        if (t == nullptr) return nullptr;
+        while (t->right != nullptr) t = t->right;
+        return t;
+    }
+
+    // Unlinks the node for salary x once its bucket is empty
+    node* remove(int x, node* t) {
+        node** link = findLink(x, &t);
+        node* temp = *link;
+        if (temp == nullptr) return t;
+        if (temp->left && temp->right) {    // if it has two children
+            node** successor = &temp->right;    // pull up the minimum of the right subtree
+            while ((*successor)->left != nullptr) successor = &(*successor)->left;
+            node* s = *successor;
+            temp->salary = s->salary;
+            temp->employees = std::move(s->employees);
+            *successor = s->right;
+            destroyNode(s);
+        }
+        else {                              // if it has one or none
+            *link = (temp->left == nullptr) ? temp->right : temp->left;
+            destroyNode(temp);
+        }
+        return t;
+    }
+
+    /* Visits, in order, only the subtrees that can hold salaries in [min, max].
+    Uses an explicit stack, so a tree that degenerated into a list (e.g. from
+    sorted input) cannot overflow the call stack. */
+    template<typename Visitor>
+    void inorderInRange(node* t, int min, int max, Visitor& visit) {
+        vector<node*> stack;
+        while (t != nullptr || !stack.empty()) {
+            while (t != nullptr) {
+                stack.push_back(t);
+                t = (min < t->salary) ? t->left : nullptr;
+            }
+            t = stack.back();
+            stack.pop_back();
+            if (t->salary > max) return;    // everything after this is larger
+            if (min <= t->salary) {
+                for (const Employee& e : t->employees) visit(e);
+            }
+            t = (t->salary < max) ? t->right : nullptr;
+        }
+    }
+
+    node* find(node* t, int x) {
+        return *findLink(x, &t);
+    }
+
+    // A subtree that bulkLoad leaves for a worker thread to build
+    struct subtree {
+        size_t lo, hi;
+        int depth;
+    };
+
+    /* Builds a balanced subtree out of the salary runs [lo, hi). Run i is
+    sorted[runs[i]] up to sorted[runs[i + 1]], and its node goes in
+    blocks[i]. With deferred set, subtrees at splitDepth are only queued
+    there: their roots are known in advance (blocks[mid]), so they can be
+    linked now and built later, in parallel. */
+    node* buildBalanced(vector<Employee>& sorted, const vector<size_t>& runs, node* const* blocks,
+                        size_t lo, size_t hi, int depth = 0, vector<subtree>* deferred = nullptr, int splitDepth = 0) {
+        if (lo == hi) return nullptr;
+        size_t mid = lo + (hi - lo) / 2;
+        if (deferred != nullptr && depth == splitDepth) {
+            deferred->push_back({ lo, hi, depth });
+            return blocks[mid];
+        }
+        node* t = new (blocks[mid]) node(std::move(sorted[runs[mid]]));
+        t->employees.insert(t->employees.end(),
+            make_move_iterator(sorted.begin() + runs[mid] + 1),
+            make_move_iterator(sorted.begin() + runs[mid + 1]));
+        t->left = buildBalanced(sorted, runs, blocks, lo, mid, depth + 1, deferred, splitDepth);
+        t->right = buildBalanced(sorted, runs, blocks, mid + 1, hi, depth + 1, deferred, splitDepth);
+        return t;
+    }
+
+    // Salaries of the nodes on the top levels of t that lie in (min, max],
+    // in order. Each level doubles how many there are.
+    void splitPoints(node* t, int min, int max, int levels, vector<int>& out) {
+        if (t == nullptr || levels == 0) return;
+        if (min < t->salary) splitPoints(t->left, min, max, levels - 1, out);
+        if (min < t->salary && t->salary <= max) out.push_back(t->salary);
+        if (t->salary < max) splitPoints(t->right, min, max, levels - 1, out);
+    }
+
+    /* Salaries that cut [min, max] into ranges for the threads of the shared
+    WorkerPool, about 16 per thread across the whole tree, or none with one
+    thread. Range i runs from cuts[i - 1] to cuts[i] - 1, with min and max
+    at the ends. */
+    vector<int> cutPoints(int min, int max) {
+        vector<int> cuts;
+        size_t threads = WorkerPool::shared().size();
+        int levels = 0;
+        while ((size_t(1) << levels) < 16 * threads) levels++;
+        if (threads > 1) splitPoints(root, min, max, levels, cuts);
+        return cuts;
+    }
+
+    // Walks the path from the root to the first node for which goLeft holds
+    // in in-order position, the same way std::lower_bound bisects an array.
+    template<typename Predicate>
+    vector<node*> boundPath(Predicate goLeft) const {
+        vector<node*> path;
+        size_t depth = 0;   // length of the path to the best candidate so far
+        node* t = root;
+        while (t != nullptr) {
+            path.push_back(t);
+            if (goLeft(t)) {
+                depth = path.size();
+                t = t->left;
+            }
+            else {
+                t = t->right;
+            }
+        }
+        path.resize(depth);
+        return path;
+    }
+
+public:
+    /* Bidirectional in-order iterator over every employee. The BST nodes
+    have no parent pointers, so the iterator carries the path of ancestors
+    from the root down to the current node, plus a position in that node's
+    bucket; an empty path is end(). Employees are read-only through the
+    iterator, since changing a salary in place would break the order. */
+    class const_iterator {
+        friend class EmployeeBST;
+
+        const EmployeeBST* tree = nullptr;
+        vector<node*> path;
+        size_t index = 0;
+
+        const_iterator(const EmployeeBST* tree, vector<node*> path) :
+            tree(tree),
+            path(std::move(path)) {}
+
+        // Push n and then its leftmost (or rightmost) descendants.
+        void descend(node* n, bool leftmost) {
+            while (n != nullptr) {
+                path.push_back(n);
+                n = leftmost ? n->left : n->right;
+            }
+        }
+
+    public:
+        using iterator_category = bidirectional_iterator_tag;
+        using value_type = Employee;
+        using difference_type = ptrdiff_t;
+        using pointer = const Employee*;
+        using reference = const Employee&;
+
+        const_iterator() {}
+
+        reference operator*() const { return path.back()->employees[index]; }
+        pointer operator->() const { return &path.back()->employees[index]; }
+
+        const_iterator& operator++() {
+            node* n = path.back();
+            if (++index < n->employees.size()) return *this;
+            index = 0;
+            if (n->right != nullptr) {
+                descend(n->right, true);
+                return *this;
+            }
+            path.pop_back();    // climb until we leave a left subtree
+            while (!path.empty() && path.back()->right == n) {
+                n = path.back();
+                path.pop_back();
+            }
+            return *this;
+        }
+
+        const_iterator& operator--() {
+            if (path.empty()) {     // end() steps back to the maximum
+                descend(tree->root, false);
+            }
+            else if (index > 0) {
+                --index;
+                return *this;
+            }
+            else if (path.back()->left != nullptr) {
+                descend(path.back()->left, false);
+            }
+            else {
+                node* n = path.back();
+                path.pop_back();    // climb until we leave a right subtree
+                while (!path.empty() && path.back()->left == n) {
+                    n = path.back();
+                    path.pop_back();
+                }
+            }
+            index = path.empty() ? 0 : path.back()->employees.size() - 1;
+            return *this;
+        }
+
+        const_iterator operator++(int) { const_iterator old = *this; ++*this; return old; }
+        const_iterator operator--(int) { const_iterator old = *this; --*this; return old; }
+
+        bool operator==(const const_iterator& other) const {
+            if (path.empty() || other.path.empty()) return path.empty() && other.path.empty();
+            return path.back() == other.path.back() && index == other.index;
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+    };
+    using iterator = const_iterator;
+
+    EmployeeBST(unique_ptr<NodeAllocator> nodeAllocator = make_unique<PoolAllocator>()) :
+        allocator(std::move(nodeAllocator)) {
+        root = nullptr;
+    }
+
+    ~EmployeeBST() {
+        bool bulk = allocator->canRelease();
+        root = makeEmpty(root, !bulk);
+        if (bulk) allocator->release();
+    }
+
+    const AllocatorStats& allocatorStats() const {
+        return allocator->stats();
+    }
+
+    void insert(const Employee& x) {
+        insert(Employee(x));
+    }
+
+    void insert(Employee&& x) {
+        insertRun(&x, &x + 1);
+    }
+
+    // Builds the employee from args and moves it straight into its bucket.
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        insert(Employee(std::forward<Args>(args)...));
+    }
+
+    void remove(const Employee& x) {
+        removeRun(&x, &x + 1);
+    }
+
+    /* Chooses how ties are ordered from now on. Switching to keyOrder
+    sorts every bucket already in the tree once. */
+    void orderTies(tieOrder order) {
+        if (order == keyOrder && ties != keyOrder) {
+            vector<node*> pending;
+            if (root != nullptr) pending.push_back(root);
+            while (!pending.empty()) {
+                node* t = pending.back();
+                pending.pop_back();
+                sort(t->employees.begin(), t->employees.end(), EmployeeKeyLess());
+                if (t->left != nullptr) pending.push_back(t->left);
+                if (t->right != nullptr) pending.push_back(t->right);
+            }
+        }
+        ties = order;
+    }
+
+    tieOrder tieOrdering() const {
+        return ties;
+    }
+
+    // Whether e itself is stored, not just someone earning its salary
+    bool contains(const Employee& e) {
+        node* t = find(root, e.salary);
+        return t != nullptr && findInBucket(t->employees, e) != t->employees.end();
+    }
+
+    void clear() {
+        root = makeEmpty(root);
+        for (unique_ptr<NameIndex>& index : nameIndexes) {
+            if (index) index->clear();
+        }
+    }
+
+    /* Adds every employee in [first, last) and rebuilds the whole tree
+    perfectly balanced, bottom-up. Runs in O(n) when the input is already
+    sorted by salary (checked, not assumed) and O(n log n) otherwise.
+    Under insertionOrder, employees sharing a salary keep their relative
+    order, after the ones already in the tree. Large inputs are sorted and
+    built on the shared WorkerPool. */
+    template<typename InputIt>
+    void bulkLoad(InputIt first, InputIt last) {
+        vector<Employee> incoming(first, last);
+        if (!is_sorted(incoming.begin(), incoming.end())) {
+            parallelStableSort(incoming);
+        }
+        for (const Employee& e : incoming) addToIndexes(e);
+        vector<Employee> sorted;
+        if (root == nullptr) {
+            sorted = std::move(incoming);
+        }
+        else {
+            vector<Employee> existing(begin(), end());
+            sorted.reserve(existing.size() + incoming.size());
+            merge(existing.begin(), existing.end(), incoming.begin(), incoming.end(), back_inserter(sorted));
+            root = makeEmpty(root);     // not clear(), which would empty the indexes too
+        }
+        vector<size_t> runs;    // where each distinct salary starts
+        for (size_t i = 0; i < sorted.size(); i++) {
+            if (i == 0 || sorted[i].salary != sorted[i - 1].salary) runs.push_back(i);
+        }
+        size_t distinct = runs.size();
+        runs.push_back(sorted.size());
+        if (ties == keyOrder) sortRuns(sorted, runs);
+        vector<node*> blocks(distinct);     // one node per salary, in salary order
+        for (node*& b : blocks) b = static_cast<node*>(allocator->allocate(sizeof(node)));
+
+        WorkerPool& pool = WorkerPool::shared();
+        if (pool.size() == 1 || distinct < 4096) {
+            root = buildBalanced(sorted, runs, blocks.data(), 0, distinct);
+            return;
+        }
+        // The top levels here, then about four subtrees per thread on the pool
+        int splitDepth = 0;
+        while ((size_t(1) << splitDepth) < 4 * pool.size()) splitDepth++;
+        vector<subtree> deferred;
+        root = buildBalanced(sorted, runs, blocks.data(), 0, distinct, 0, &deferred, splitDepth);
+        pool.run(deferred.size(), [&](size_t i) {
+            buildBalanced(sorted, runs, blocks.data(), deferred[i].lo, deferred[i].hi, deferred[i].depth);
+        });
+    }
+
+    template<typename Range>
+    void bulkLoad(const Range& employees) {
+        bulkLoad(std::begin(employees), std::end(employees));
+    }
+
+    /* Keeps a NameIndex on field f from now on, built from the employees
+    already stored. Every insert and remove after that also updates it. */
+    void addIndex(NameIndex::field f) {
+        if (nameIndexes[f]) return;
+        nameIndexes[f] = make_unique<NameIndex>(f);
+        for (const Employee& e : *this) nameIndexes[f]->add(e);
+    }
+
+    void dropIndex(NameIndex::field f) {
+        nameIndexes[f].reset();
+    }
+
+    bool hasIndex(NameIndex::field f) const {
+        return nameIndexes[f] != nullptr;
+    }
+
+    /* Every employee whose field f is exactly name, in salary order.
+    Without an index on f this scans the whole tree. */
+    vector<Employee> findByName(NameIndex::field f, string_view name) {
+        vector<Employee> out;
+        uint32_t id;
+        if (!StringPool::shared().find(name, id)) return out;  // nobody has ever had this name
+        if (nameIndexes[f]) return lookup(*nameIndexes[f], { id });
+        forEachInRange(INT_MIN, INT_MAX, [&](const Employee& e) {
+            if (NameIndex::key(e, f).id() == id) out.push_back(e);
+        });
+        return out;
+    }
+
+    /* Every employee whose field f starts with prefix, in salary order.
+    Without an index on f this scans the whole tree. */
+    vector<Employee> findByPrefix(NameIndex::field f, string_view prefix) {
+        if (nameIndexes[f]) return lookup(*nameIndexes[f], nameIndexes[f]->withPrefix(prefix));
+        vector<Employee> out;
+        forEachInRange(INT_MIN, INT_MAX, [&](const Employee& e) {
+            if (NameIndex::key(e, f).view().substr(0, prefix.size()) == prefix) out.push_back(e);
+        });
+        return out;
+    }
+
+    /* Adds every employee in [first, last). The batch is sorted by salary
+    first, so back-to-back descents share the cache-hot upper levels and
+    everyone on one salary goes in with a single descent. Into an empty
+    tree it is a bulkLoad. */
+    template<typename InputIt>
+    void insertBatch(InputIt first, InputIt last) {
+        if (root == nullptr) {
+            bulkLoad(first, last);
+            return;
+        }
+        vector<Employee> batch(first, last);
+        parallelStableSort(batch);
+        for (size_t i = 0, j; i < batch.size(); i = j) {
+            for (j = i + 1; j < batch.size() && batch[j].salary == batch[i].salary; j++) {}
+            insertRun(batch.data() + i, batch.data() + j);
+        }
+    }
+
+    template<typename Range>
+    void insertBatch(const Range& employees) {
+        insertBatch(std::begin(employees), std::end(employees));
+    }
+
+    /* Removes one copy of every employee in [first, last) that is stored,
+    and returns how many were. Sorted like insertBatch, with one descent
+    per salary and one pass over each bucket it touches. */
+    template<typename InputIt>
+    size_t removeBatch(InputIt first, InputIt last) {
+        vector<Employee> batch(first, last);
+        parallelStableSort(batch);
+        size_t removed = 0;
+        for (size_t i = 0, j; i < batch.size(); i = j) {
+            for (j = i + 1; j < batch.size() && batch[j].salary == batch[i].salary; j++) {}
+            removed += removeRun(batch.data() + i, batch.data() + j);
+        }
+        return removed;
+    }
+
+    template<typename Range>
+    size_t removeBatch(const Range& employees) {
+        return removeBatch(std::begin(employees), std::end(employees));
+    }
+
+    /* findAll for every salary in salaries, answered in the same order.
+    The lookups are sorted and resolved in one walk down the tree that
+    splits them at each node, so a node is read once however many lookups
+    pass through it. The spans are valid until the tree next changes. */
+    vector<EmployeeSpan> findBatch(const vector<int>& salaries) {
+        vector<pair<int, size_t>> queries(salaries.size());     // salary, position in salaries
+        for (size_t i = 0; i < salaries.size(); i++) queries[i] = { salaries[i], i };
+        sort(queries.begin(), queries.end());
+        vector<EmployeeSpan> out(salaries.size());
+        struct pending {
+            node* t;
+            size_t lo, hi;      // the queries that reach t
+        };
+        vector<pending> stack;
+        if (!queries.empty()) stack.push_back({ root, 0, queries.size() });
+        while (!stack.empty()) {
+            pending p = stack.back();
+            stack.pop_back();
+            if (p.t == nullptr) continue;
+            // [lo, here) go left, [here, right) earn t's salary, [right, hi) go right
+            auto begin = queries.begin();
+            size_t here = std::lower_bound(begin + p.lo, begin + p.hi, make_pair(p.t->salary, size_t(0))) - begin;
+            size_t right = here;
+            while (right < p.hi && queries[right].first == p.t->salary) {
+                out[queries[right++].second] = EmployeeSpan(p.t->employees.data(), p.t->employees.size());
+            }
+            if (p.lo < here) stack.push_back({ p.t->left, p.lo, here });
+            if (right < p.hi) stack.push_back({ p.t->right, right, p.hi });
+        }
+        return out;
+    }
+
+    void display() {
+        printInRange(INT_MIN, INT_MAX);
+        cout << endl;
+    }
+
+    Employee* search(int x) {
+        node* result = find(root, x);
+        if (result == nullptr) return nullptr;
+        return &result->employees.front();
+    }
+
+    const_iterator begin() const {
+        const_iterator it(this, {});
+        it.descend(root, true);
+        return it;
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, {});
+    }
+
+    // First employee whose salary is not less than x.
+    const_iterator lower_bound(int x) const {
+        return const_iterator(this, boundPath([x](node* t) { return t->salary >= x; }));
+    }
+
+    // First employee whose salary is greater than x.
+    const_iterator upper_bound(int x) const {
+        return const_iterator(this, boundPath([x](node* t) { return t->salary > x; }));
+    }
+
+    pair<const_iterator, const_iterator> equal_range(int x) const {
+        return { lower_bound(x), upper_bound(x) };
+    }
+
+    // Every employee earning exactly x, in insertion or key order (see tieOrder)
+    EmployeeSpan findAll(int x) {
+        node* t = find(root, x);
+        if (t == nullptr) return EmployeeSpan();
+        return EmployeeSpan(t->employees.data(), t->employees.size());
+    }
+
+    /* Calls visit(const Employee&) on every employee with a salary in
+    [min, max], in salary order. Runs in O(log n + k) for k matches. */
+    template<typename Visitor>
+    void forEachInRange(int min, int max, Visitor visit) {
+        inorderInRange(root, min, max, visit);
+    }
+
+    // Writes every employee with a salary in [min, max] to out, in order.
+    template<typename OutputIt>
+    OutputIt copyInRange(int min, int max, OutputIt out) {
+        forEachInRange(min, max, [&out](const Employee& e) { *out++ = e; });
+        return out;
+    }
+
+    /* Every employee with a salary in [min, max], in order. Wide ranges
+    are cut into parts that are collected in parallel and then joined. */
+    vector<Employee> findInRange(int min, int max) {
+        vector<int> cuts = cutPoints(min, max);
+        vector<Employee> out;
+        if (cuts.empty()) {
+            copyInRange(min, max, back_inserter(out));
+            return out;
+        }
+        vector<vector<Employee>> parts(cuts.size() + 1);
+        WorkerPool::shared().run(parts.size(), [&](size_t i) {
+            copyInRange(i == 0 ? min : cuts[i - 1], i == cuts.size() ? max : cuts[i] - 1, back_inserter(parts[i]));
+        });
+        size_t total = 0;
+        for (const vector<Employee>& part : parts) total += part.size();
+        out.reserve(total);
+        for (const vector<Employee>& part : parts) out.insert(out.end(), part.begin(), part.end());
+        return out;
+    }
+
+    /* Prints every employee with a salary in [min, max], in order. Wide
+    ranges are cut into parts that are formatted in parallel, two per
+    thread at a time, and written out in order. */
+    void printInRange(int min, int max, ostream& os = cout) {
+        vector<int> cuts = cutPoints(min, max);
+        if (cuts.empty()) {
+            forEachInRange(min, max, [&os](const Employee& e) { os << e << '\n'; });
+            os.flush();
+            return;
+        }
+        WorkerPool& pool = WorkerPool::shared();
+        vector<string> text(2 * pool.size());
+        for (size_t first = 0; first <= cuts.size(); first += text.size()) {
+            size_t count = std::min(text.size(), cuts.size() + 1 - first);
+            pool.run(count, [&](size_t i) {
+                size_t part = first + i;
+                ostringstream out;
+                forEachInRange(part == 0 ? min : cuts[part - 1], part == cuts.size() ? max : cuts[part] - 1,
+                    [&out](const Employee& e) { out << e << '\n'; });
+                text[i] = out.str();
+            });
+            for (size_t i = 0; i < count; i++) os.write(text[i].data(), (streamsize)text[i].size());
+        }
+        os.flush();
+    }
+};
+
+/* Counting how many of a node's 16 sorted keys are below a salary is the
+inner loop of every SalaryIndex lookup. The SIMD kernels compare all 16
+keys at once and count the matching lanes instead of taking one branch
+per key. The fastest kernel the CPU supports is picked once,
+at first use, and can be overridden for benchmarking. */
+class KeySearch {
+public:
+    enum kernel { scalar, sse2, avx2 };     // ordered from slowest to fastest
+
+    static int rankScalar(const int* keys, int x) {
+        int r = 0;
+        for (int i = 0; i < 16; i++) r += (keys[i] < x);
+        return r;
+    }
+
+#if EMPLOYEE_X86
+    // keys must be 16-byte aligned
+    static TARGET_SSE2 int rankSse2(const int* keys, int x) {
+        __m128i v = _mm_set1_epi32(x);
+        __m128i a = _mm_cmpgt_epi32(v, _mm_load_si128((const __m128i*)keys));
+        __m128i b = _mm_cmpgt_epi32(v, _mm_load_si128((const __m128i*)(keys + 4)));
+        __m128i c = _mm_cmpgt_epi32(v, _mm_load_si128((const __m128i*)(keys + 8)));
+        __m128i d = _mm_cmpgt_epi32(v, _mm_load_si128((const __m128i*)(keys + 12)));
+        // Each lane is -1 where the key is below x; add them all up.
+        __m128i sum = _mm_add_epi32(_mm_add_epi32(a, b), _mm_add_epi32(c, d));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+        return -_mm_cvtsi128_si32(sum);
+    }
+
+    // keys must be 32-byte aligned
+    static TARGET_AVX2 int rankAvx2(const int* keys, int x) {
+        __m256i v = _mm256_set1_epi32(x);
+        __m256i lo = _mm256_cmpgt_epi32(v, _mm256_load_si256((const __m256i*)keys));
+        __m256i hi = _mm256_cmpgt_epi32(v, _mm256_load_si256((const __m256i*)(keys + 8)));
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(lo))
+            | ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(hi)) << 8);
+        return (int)_mm_popcnt_u32(mask);
+    }
+#endif
+
+    // Number of the 16 keys that are less than x
+    static int rank(const int* keys, int x) {
+        switch (active()) {
+#if EMPLOYEE_X86
+        case avx2: return rankAvx2(keys, x);
+        case sse2: return rankSse2(keys, x);
+#endif
+        default: return rankScalar(keys, x);
+        }
+    }
+
+    // Best kernel this CPU (and OS) can run
+    static kernel detect() {
+#if EMPLOYEE_X86 && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        bool hasSse2 = (info[3] & (1 << 26)) != 0;
+        bool hasPopcnt = (info[2] & (1 << 23)) != 0;
+        bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+        bool hasAvx2 = false;
+        if (maxLeaf >= 7 && hasPopcnt && osSavesYmm) {
+            __cpuidex(info, 7, 0);
+            hasAvx2 = (info[1] & (1 << 5)) != 0;
+        }
+        if (hasAvx2) return avx2;
+        if (hasSse2) return sse2;
+#elif EMPLOYEE_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return avx2;
+        if (__builtin_cpu_supports("sse2")) return sse2;
+#endif
+        return scalar;
+    }
+
+    static kernel active() {
+        return selected();
+    }
+
+    // Forces a kernel; fails if the CPU cannot run it.
+    static bool use(kernel k) {
+        if (k > detect()) return false;
+        selected() = k;
+        return true;
+    }
+
+    static const char* name(kernel k) {
+        switch (k) {
+        case avx2: return "avx2";
+        case sse2: return "sse2";
+        default: return "scalar";
+        }
+    }
+
+private:
+    static kernel& selected() {
+        static kernel k = detect();
+        return k;
+    }
+};
+
+/* A frozen, read-optimized copy of a tree for read-mostly workloads.
+The employees are copied once, in salary order, into one contiguous
+payload array. The distinct salaries are indexed by a static B+ tree
+whose nodes are 16 keys filling exactly one 64-byte cache line, so a
+lookup touches one line per level instead of chasing a pointer per
+level. Every run of equal salaries, and every salary range, is a
+contiguous span of the payload. Changes to the source tree after
+construction are not seen. */
+class SalaryIndex {
+public:
+    static constexpr int B = 16;    // keys per node
+
+private:
+    struct alignas(64) keyBlock {
+        int keys[B];
+    };
+
+    vector<Employee> records;   // payload, sorted by salary
+    vector<size_t> offsets;     // distinct salary i owns records[offsets[i], offsets[i + 1])
+    size_t distinct = 0;
+    vector<keyBlock> blocks;    // every layer, root layer first
+    vector<size_t> layerStart;  // first block of each layer, root layer first
+
+    // Number of keys in the block that are less than x
+    static int rank(const keyBlock& b, int x) {
+        return KeySearch::rank(b.keys, x);
+    }
+
+    // Position of the first distinct salary that is not less than x
+    size_t lowerBound(int x) const {
+        if (distinct == 0) return 0;
+        size_t i = 0;       // block within the current layer
+        size_t layers = layerStart.size();
+        for (size_t k = 0; k + 1 < layers; k++) {
+            i = i * (B + 1) + rank(blocks[layerStart[k] + i], x);
+        }
+        size_t pos = i * B + rank(blocks[layerStart[layers - 1] + i], x);
+        return pos < distinct ? pos : distinct;
+    }
+
+    // The pos-th distinct salary, read from the leaf layer
+    int keyAt(size_t pos) const {
+        return blocks[layerStart.back() + pos / B].keys[pos % B];
+    }
+
+    size_t upperBound(int x) const {
+        return x == INT_MAX ? distinct : lowerBound(x + 1);
+    }
+
+    void build() {
+        for (size_t i = 0; i < records.size(); i++) {
+            if (i == 0 || records[i].salary != records[i - 1].salary) offsets.push_back(i);
+        }
+        distinct = offsets.size();
+        offsets.push_back(records.size());
+
+        // Layer sizes from the leaves up; each inner node has B + 1 children.
+        vector<size_t> sizes{ max<size_t>(1, (distinct + B - 1) / B) };
+        while (sizes.back() > 1) sizes.push_back((sizes.back() + B) / (B + 1));
+        size_t total = 0;
+        for (size_t k = sizes.size(); k-- > 0;) {
+            layerStart.push_back(total);
+            total += sizes[k];
+        }
+        blocks.resize(total);
+
+        keyBlock* leaves = &blocks[layerStart.back()];
+        for (size_t i = 0; i < sizes[0] * B; i++) {
+            leaves[i / B].keys[i % B] = i < distinct ? records[offsets[i]].salary : INT_MAX;
+        }
+        // Key j of an inner node is the smallest salary under child j + 1,
+        // which is the first key of that child's leftmost leaf.
+        size_t span = 1;    // leaves under one node of the layer below
+        for (size_t level = 1; level < sizes.size(); level++) {
+            keyBlock* layer = &blocks[layerStart[sizes.size() - 1 - level]];
+            for (size_t i = 0; i < sizes[level]; i++) {
+                for (int j = 0; j < B; j++) {
+                    size_t leaf = (i * (B + 1) + j + 1) * span;
+                    layer[i].keys[j] = leaf < sizes[0] ? leaves[leaf].keys[0] : INT_MAX;
+                }
+            }
+            span *= B + 1;
+        }
+    }
+
+public:
+    SalaryIndex() {
+        build();
+    }
+
+    // Indexes the employees in [first, last), e.g. a tree's begin() and end().
+    template<typename InputIt>
+    SalaryIndex(InputIt first, InputIt last) : records(first, last) {
+        if (!is_sorted(records.begin(), records.end())) {
+            stable_sort(records.begin(), records.end());
+        }
+        build();
+    }
+
+    size_t size() const { return records.size(); }
+    const Employee* begin() const { return records.data(); }
+    const Employee* end() const { return records.data() + records.size(); }
+
+    const Employee* find(int x) const {
+        EmployeeSpan all = findAll(x);
+        return all.empty() ? nullptr : all.begin();
+    }
+
+    EmployeeSpan findAll(int x) const {
+        size_t pos = lowerBound(x);
+        if (pos == distinct || keyAt(pos) != x) return EmployeeSpan();
+        return EmployeeSpan(records.data() + offsets[pos], offsets[pos + 1] - offsets[pos]);
+    }
+
+    // Every employee with a salary in [min, max], which is always contiguous
+    EmployeeSpan inRange(int min, int max) const {
+        if (min > max) return EmployeeSpan();
+        size_t first = offsets[lowerBound(min)];
+        size_t last = offsets[upperBound(max)];
+        return EmployeeSpan(records.data() + first, last - first);
+    }
+
+    template<typename Visitor>
+    void forEachInRange(int min, int max, Visitor visit) const {
+        for (const Employee& e : inRange(min, max)) visit(e);
+    }
+
+    template<typename OutputIt>
+    OutputIt copyInRange(int min, int max, OutputIt out) const {
+        EmployeeSpan range = inRange(min, max);
+        return copy(range.begin(), range.end(), out);
+    }
+
+    vector<Employee> findInRange(int min, int max) const {
+        EmployeeSpan range = inRange(min, max);
+        return vector<Employee>(range.begin(), range.end());
+    }
+
+    void printInRange(int min, int max, ostream& os = cout) const {
+        for (const Employee& e : inRange(min, max)) os << e << '\n';
+        os.flush();
+    }
+};
+
+/* A read-only memory mapping of a whole file. */
+class MappedFile {
+    const char* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    // Maps path; returns false if it cannot be opened or is empty.
+    bool open(const string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            close();
+            return false;
+        }
+        base = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        length = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);        // the mapping keeps the file alive
+        if (p == MAP_FAILED) return false;
+        base = static_cast<const char*>(p);
+        length = (size_t)info.st_size;
+#endif
+        if (base == nullptr) {
+            close();
+            return false;
+        }
+        return true;
     }
 
-    friend ostream& operator<<(ostream& os, const Employee& obj) {
-        os << obj.firstName << " " << obj.lastName << ", " << obj.jobTitle << " ($" << obj.salary << ")";
-        return os;
+    void close() {
+#ifdef _WIN32
+        if (base != nullptr) UnmapViewOfFile(base);
+        if (mapping != nullptr) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base != nullptr) munmap(const_cast<char*>(base), length);
+#endif
+        base = nullptr;
+        length = 0;
     }
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
 };
 
-class EmployeeBST {
+/* A versioned binary snapshot of a roster. The file is a 64-byte header,
+then fixed-size 16-byte records sorted by salary, then a string table of
+offsets into a string heap. Strings are numbered per snapshot, so a file
+does not depend on the StringPool ids of the process that wrote it.
 
-    struct node {
-        node(Employee data) : data(data), left(nullptr), right(nullptr) {}
+open() maps the file and checks the header and the string table, never
+the records, so it costs one pass over the distinct names. Queries then
+binary-search the mapped records and read names straight out of the
+mapped heap, without building any Employee objects. employees() converts
+the records when a mutable tree is needed, interning each distinct string
+once. */
+class Snapshot {
+public:
+    static constexpr uint32_t currentVersion = 1;
 
-        Employee data;
-        node* left;
-        node* right;
+    struct header {
+        char magic[8];          // "EMPSNAP" and a zero byte
+        uint32_t version;
+        uint32_t byteOrder;     // 0x01020304 as written by the saving machine
+        uint64_t recordCount;
+        uint64_t stringCount;
+        uint64_t heapBytes;
+        uint64_t reserved[3];
     };
 
-    node* root;
+    struct record {
+        int32_t salary;
+        uint32_t firstName;     // indexes into the string table
+        uint32_t lastName;
+        uint32_t jobTitle;
+    };
 
-    node* makeEmpty(node* t) {
-        if (t == nullptr)
-            return nullptr;
-        {
-            makeEmpty(t->left);
-            makeEmpty(t->right);
-            delete t;
+    // One employee as seen through the mapping
+    struct row {
+        int salary;
+        string_view firstName;
+        string_view lastName;
+        string_view jobTitle;
+
+        friend ostream& operator<<(ostream& os, const row& obj) {
+            os << obj.firstName << " " << obj.lastName << ", " << obj.jobTitle << " ($" << obj.salary << ")";
+            return os;
         }
-        return nullptr;
+    };
+
+private:
+    static constexpr char magicBytes[8] = { 'E', 'M', 'P', 'S', 'N', 'A', 'P', '\0' };
+    static constexpr uint32_t byteOrderMark = 0x01020304;
+
+    MappedFile file;
+    const header* head = nullptr;
+    const record* records = nullptr;
+    const uint64_t* stringOffsets = nullptr;    // stringCount + 1 entries
+    const char* heap = nullptr;
+
+    string_view stringAt(uint32_t id) const {
+        if (id >= head->stringCount) throw runtime_error("Snapshot string id out of range");
+        return string_view(heap + stringOffsets[id], size_t(stringOffsets[id + 1] - stringOffsets[id]));
     }
 
-    node* insert(Employee x, node* t) {
-        if (t == nullptr) {
-            t = new node(x);
-        }
-        else if (x < t->data) {
-            t->left = insert(x, t->left);
-        }
-        else {
-            t->right = insert(x, t->right);
-        }
-        return t;
+    const record* lowerBound(int salary) const {
+        return std::lower_bound(records, records + head->recordCount, salary,
+            [](const record& r, int x) { return r.salary < x; });
     }
 
-    node* findMin(node* t) {
-        if (t == nullptr) return nullptr;
-        else if (t->left == nullptr) return t;
-        else return findMin(t->left);
+    // Forces the contents of the file at path out to disk
+    static void syncFile(const string& path) {
+#ifdef _WIN32
+        HANDLE h = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        bool synced = h != INVALID_HANDLE_VALUE && FlushFileBuffers(h);
+        if (h != INVALID_HANDLE_VALUE) CloseHandle(h);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        bool synced = fd >= 0 && fsync(fd) == 0;
+        if (fd >= 0) ::close(fd);
+#endif
+        if (!synced) throw runtime_error("Could not sync " + path);
     }
 
-    node* findMax(node* t) {
-        if (t == nullptr) return nullptr;
-        else if (t->right == nullptr) return t;
-        else return findMax(t->right);
+    // Forces the directory entry naming path out to disk, so a rename onto
+    // it survives a crash. On Windows MOVEFILE_WRITE_THROUGH does this.
+    static void syncDirectory(const string& path) {
+#ifndef _WIN32
+        size_t slash = path.rfind('/');
+        string directory = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        int fd = ::open(directory.c_str(), O_RDONLY);
+        bool synced = fd >= 0 && fsync(fd) == 0;
+        if (fd >= 0) ::close(fd);
+        if (!synced) throw runtime_error("Could not sync " + directory);
+#endif
     }
 
-    node* remove(Employee x, node* t) {
-        node* temp;
-        if (t == nullptr) return nullptr;
-        else if (x != t->data) { // traverse down the tree
-            if (x < t->data) {
-                t->left = remove(x, t->left);
-            }
-            else if (x > t->data) {
-                t->right = remove(x, t->right);
+public:
+    /* Writes [first, last) to path and returns the number of employees
+    written. The file is written next to path, synced, renamed over it and
+    the rename synced, so a crash leaves the old snapshot or the new one,
+    never a torn one, and the new one is on disk by the time save() returns. */
+    template<typename InputIt>
+    static size_t save(const string& path, InputIt first, InputIt last) {
+        vector<record> rows;
+        vector<uint32_t> poolIds;               // snapshot string id -> StringPool id
+        unordered_map<uint32_t, uint32_t> localIds;
+        auto local = [&](InternedString s) {
+            auto found = localIds.emplace(s.id(), (uint32_t)poolIds.size());
+            if (found.second) poolIds.push_back(s.id());
+            return found.first->second;
+        };
+        for (; first != last; ++first) {
+            const Employee& e = *first;
+            rows.push_back({ e.salary, local(e.firstName), local(e.lastName), local(e.jobTitle) });
+        }
+        stable_sort(rows.begin(), rows.end(), [](const record& a, const record& b) { return a.salary < b.salary; });
+
+        vector<uint64_t> offsets{ 0 };
+        offsets.reserve(poolIds.size() + 1);
+        for (uint32_t id : poolIds) offsets.push_back(offsets.back() + StringPool::shared().view(id).size());
+
+        header h{};
+        copy(begin(magicBytes), end(magicBytes), h.magic);
+        h.version = currentVersion;
+        h.byteOrder = byteOrderMark;
+        h.recordCount = rows.size();
+        h.stringCount = poolIds.size();
+        h.heapBytes = offsets.back();
+
+        string temp = path + ".tmp";
+        {
+            ofstream out(temp, ios::binary | ios::trunc);
+            if (!out) throw runtime_error("Could not write " + temp);
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            out.write(reinterpret_cast<const char*>(rows.data()), streamsize(rows.size() * sizeof(record)));
+            out.write(reinterpret_cast<const char*>(offsets.data()), streamsize(offsets.size() * sizeof(uint64_t)));
+            for (uint32_t id : poolIds) {
+                string_view s = StringPool::shared().view(id);
+                out.write(s.data(), streamsize(s.size()));
             }
+            out.flush();
+            if (!out) throw runtime_error("Could not write " + temp);
         }
-        // found a node with the same salary
-        else if (t->left && t->right) {         // if it has two children
-            temp = findMin(t->right);
-            t->data = temp->data;
-            t->right = remove(t->data, t->right);
+        syncFile(temp);         // before the rename, or a crash could leave path naming an empty file
+#ifdef _WIN32
+        if (!MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+#else
+        if (rename(temp.c_str(), path.c_str()) != 0) {
+#endif
+            throw runtime_error("Could not replace " + path);
         }
-        else {                                  // if it has one
-            temp = t;
-            if (t->left == nullptr) {
-                t = t->right;
-            }
-            else if (t->right == nullptr) {
-                t = t->left;
-            }
-            delete temp;
+        syncDirectory(path);
+        return rows.size();
+    }
+
+    /* Maps path. Returns false if there is no such file, and throws if the
+    file is not a snapshot this build can read. */
+    bool open(const string& path) {
+        head = nullptr;
+        if (!file.open(path)) return false;
+        const char* base = file.data();
+        if (file.size() < sizeof(header)) throw runtime_error(path + " is not a snapshot");
+        const header* h = reinterpret_cast<const header*>(base);
+        if (!equal(begin(magicBytes), end(magicBytes), h->magic)) throw runtime_error(path + " is not a snapshot");
+        if (h->byteOrder != byteOrderMark) throw runtime_error(path + " was written on a machine with another byte order");
+        if (h->version != currentVersion) throw runtime_error(path + " has unsupported snapshot version " + to_string(h->version));
+        // Each count is bounded by the file first, so the sum cannot overflow
+        if (h->recordCount > file.size() / sizeof(record) || h->stringCount >= file.size() / sizeof(uint64_t)
+            || h->heapBytes > file.size()) {
+            throw runtime_error(path + " is truncated or corrupt");
         }
+        uint64_t expected = sizeof(header) + h->recordCount * sizeof(record)
+            + (h->stringCount + 1) * sizeof(uint64_t) + h->heapBytes;
+        if (file.size() != expected) throw runtime_error(path + " is truncated or corrupt");
 
-        return t;
-    }
+        // stringAt() trusts the offsets, so they must climb from 0 and stay inside the heap
+        const uint64_t* offsets = reinterpret_cast<const uint64_t*>(base + sizeof(header) + h->recordCount * sizeof(record));
+        if (offsets[0] != 0) throw runtime_error(path + " has a corrupt string table");
+        for (uint64_t i = 0; i < h->stringCount; i++) {
+            if (offsets[i + 1] < offsets[i] || offsets[i + 1] > h->heapBytes) throw runtime_error(path + " has a corrupt string table");
+        }
 
-    void inorder(node* t) {
-        if (t == nullptr)
-            return;
-        inorder(t->left);
-        cout << t->data << endl;
-        inorder(t->right);
+        head = h;
+        records = reinterpret_cast<const record*>(base + sizeof(header));
+        stringOffsets = offsets;
+        heap = reinterpret_cast<const char*>(stringOffsets + h->stringCount + 1);
+        return true;
     }
 
-    void inorderConditional(node* t, function<bool(node *)> condition) {
-        if (t == nullptr) return;
-        inorderConditional(t->left, condition);
-        if (condition(t)) cout << t->data << endl;
-        inorderConditional(t->right, condition);
-    }
+    size_t size() const { return head == nullptr ? 0 : size_t(head->recordCount); }
 
-    node* find(node* t, int x) {
-        if (t == nullptr) return nullptr;
-        else if (x < t->data.salary) return find(t->left, x);
-        else if (x > t->data.salary) return find(t->right, x);
-        else return t;
+    row at(size_t i) const {
+        const record& r = records[i];
+        return { r.salary, stringAt(r.firstName), stringAt(r.lastName), stringAt(r.jobTitle) };
     }
 
-public:
-    EmployeeBST() {
-        root = nullptr;
+    // Calls visit(row) on every record with a salary in [min, max], in order.
+    template<typename Visitor>
+    void forEachInRange(int min, int max, Visitor visit) const {
+        if (head == nullptr) return;
+        const record* end = records + head->recordCount;
+        for (const record* r = lowerBound(min); r != end && r->salary <= max; ++r) {
+            visit(at(size_t(r - records)));
+        }
     }
 
-    ~EmployeeBST() {
-        root = makeEmpty(root);
+    void printInRange(int min, int max, ostream& os = cout) const {
+        forEachInRange(min, max, [&os](const row& r) { os << r << '\n'; });
+        os.flush();
     }
 
-    void insert(Employee x) {
-        root = insert(x, root);
+    // Every record as an Employee, in salary order, ready for bulkLoad.
+    vector<Employee> employees() const {
+        vector<Employee> out;
+        if (head == nullptr) return out;
+        vector<InternedString> strings;
+        strings.reserve(size_t(head->stringCount));
+        for (uint32_t id = 0; id < head->stringCount; id++) strings.emplace_back(stringAt(id));
+        out.reserve(size());
+        for (size_t i = 0; i < size(); i++) {
+            const record& r = records[i];
+            if (max(r.firstName, max(r.lastName, r.jobTitle)) >= strings.size()) {
+                throw runtime_error("Snapshot string id out of range");
+            }
+            out.emplace_back(strings[r.firstName], strings[r.lastName], strings[r.jobTitle], r.salary);
+        }
+        return out;
     }
+};
 
-    void remove(Employee x) {
-        remove(x, root);
-    }
+/* Reads and writes rosters as CSV, one employee per line in the order
+firstName,lastName,jobTitle,salary. Fields may be quoted as in RFC 4180, so
+names can hold commas, quotes and line breaks. A first line whose salary
+is not a number is taken as a header and skipped.
 
-    void display() {
-        inorder(root);
-        cout << endl;
+read() maps the file and hands out string_views into the mapping, so a
+field costs no allocation; quoted fields are unescaped into one reused buffer.
+Lines without quotes are split with memchr, which keeps the common case
+well above the speed of the disk. write() builds its output in a large
+buffer and never flushes per line. */
+class Csv {
+    static constexpr size_t bufferSize = size_t(1) << 20;
+
+    // True if s must be quoted to survive a round trip
+    static bool needsQuotes(string_view s) {
+        for (char c : s) {
+            if (c == ',' || c == '"' || c == '\r' || c == '\n') return true;
+        }
+        return false;
     }
 
-    Employee* search(int x) {
-        node* result = find(root, x);
-        if (result == nullptr) return nullptr;
-        return &result->data;
+    // Writes s at w, quoted if it needs to be, and returns the new end.
+    // There must be room for 2 * s.size() + 2 characters.
+    static char* putField(char* w, string_view s) {
+        if (!needsQuotes(s)) {
+            memcpy(w, s.data(), s.size());
+            return w + s.size();
+        }
+        *w++ = '"';
+        for (char c : s) {
+            if (c == '"') *w++ = '"';
+            *w++ = c;
+        }
+        *w++ = '"';
+        return w;
     }
 
-    vector<Employee> findAll(int x) {
-        vector<Employee> out;
-        node* y = find(root, x);
-        if (y == nullptr) return out;
-        out.push_back(y->data);
+    /* Remembers recently read strings so a name that repeats down the file,
+    as names do, is looked up without going through the StringPool lock and
+    hash table. Direct-mapped: a collision just replaces the slot. Short
+    strings are kept in the slot itself so a hit touches one cache line. */
+    class internCache {
+        static constexpr size_t inlineBytes = 19;
+
+        struct slot {
+            uint32_t hash = 0;
+            InternedString value;
+            uint8_t length = 0xff;      // 0xff: too long to keep inline, compare against the pool
+            char text[inlineBytes];
+        };
+        vector<slot> slots = vector<slot>(size_t(1) << 14);
+
+    public:
+        InternedString operator()(string_view s) {
+            uint32_t hash = 2166136261u;
+            for (char c : s) hash = (hash ^ (unsigned char)c) * 16777619u;
+            slot& entry = slots[hash & (slots.size() - 1)];
+            if (entry.hash == hash) {
+                // Check the marker first: a 255-byte string would match it as a length
+                if (entry.length == 0xff) {
+                    if (entry.value.view() == s) return entry.value;
+                }
+                else if (entry.length == s.size() && memcmp(entry.text, s.data(), s.size()) == 0) {
+                    return entry.value;
+                }
+            }
+            entry.hash = hash;
+            entry.value = InternedString(s);
+            entry.length = s.size() <= inlineBytes ? uint8_t(s.size()) : 0xff;
+            if (s.size() <= inlineBytes) memcpy(entry.text, s.data(), s.size());
+            return entry.value;
+        }
+    };
+
+    /* Splits the record starting at p into fields and returns the start of
+    the next record. Quoted fields are unescaped into scratch; their views
+    are filled in at the end, once scratch has stopped growing. */
+    static const char* splitQuoted(const char* p, const char* end, vector<string_view>& fields, string& scratch) {
+        scratch.clear();
+        vector<pair<size_t, size_t>> quoted;    // field index, start in scratch
+        auto finish = [&](const char* next) {
+            for (size_t i = 0; i < quoted.size(); i++) {
+                size_t stop = i + 1 < quoted.size() ? quoted[i + 1].second : scratch.size();
+                fields[quoted[i].first] = string_view(scratch.data() + quoted[i].second, stop - quoted[i].second);
+            }
+            return next;
+        };
         while (true) {
-            y = findMin(y->right);
-            if (y == nullptr || y->data.salary != x) break;
-            out.push_back(y->data);
+            if (p < end && *p == '"') {
+                quoted.emplace_back(fields.size(), scratch.size());
+                for (p++; p < end; p++) {
+                    if (*p == '"') {
+                        if (p + 1 < end && p[1] == '"') {
+                            scratch += '"';
+                            p++;
+                        }
+                        else {
+                            p++;
+                            break;
+                        }
+                    }
+                    else {
+                        scratch += *p;
+                    }
+                }
+                fields.push_back(string_view());
+                // Anything between the closing quote and the delimiter is ignored
+                while (p < end && *p != ',' && *p != '\n') p++;
+            }
+            else {
+                const char* start = p;
+                while (p < end && *p != ',' && *p != '\n') p++;
+                const char* stop = p;
+                if (stop > start && stop[-1] == '\r' && (p == end || *p == '\n')) stop--;
+                fields.push_back(string_view(start, size_t(stop - start)));
+            }
+            if (p == end) return finish(end);
+            if (*p++ == '\n') return finish(p);
         }
-        return out;
     }
 
-    void printInRange(int min, int max) {
-        inorderConditional(root, [min, max](node* t) {
-            return t->data.salary >= min && t->data.salary <= max;
-        });
+public:
+    /* Calls visit(Employee&&) for every row of the file at path and returns
+    the number of rows. Throws runtime_error naming the line of the first
+    malformed row. */
+    template<typename Visitor>
+    static size_t read(const string& path, Visitor visit) {
+        MappedFile file;
+        if (!file.open(path)) {
+            ifstream probe(path);
+            if (!probe) throw runtime_error("Could not open " + path);
+            return 0;       // an empty file
+        }
+        const char* p = file.data();
+        const char* end = p + file.size();
+        vector<string_view> fields;
+        string scratch;
+        internCache intern[3];      // one per column, since names rarely turn up as titles
+        size_t line = 0;            // where the current record starts
+        size_t nextLine = 1;
+        size_t rows = 0;
+        while (p < end) {
+            line = nextLine++;
+            const char* next = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+            const char* stop = next == nullptr ? end : next;
+            fields.clear();
+            if (memchr(p, '"', size_t(stop - p)) != nullptr) {
+                const char* start = p;
+                p = splitQuoted(p, end, fields, scratch);
+                nextLine += size_t(count(start, p, '\n')) - (p[-1] == '\n' ? 1 : 0);
+            }
+            else {
+                const char* lineEnd = (stop > p && stop[-1] == '\r') ? stop - 1 : stop;
+                for (const char* field = p;;) {
+                    const char* comma = static_cast<const char*>(memchr(field, ',', size_t(lineEnd - field)));
+                    if (comma == nullptr) {
+                        fields.push_back(string_view(field, size_t(lineEnd - field)));
+                        break;
+                    }
+                    fields.push_back(string_view(field, size_t(comma - field)));
+                    field = comma + 1;
+                }
+                p = next == nullptr ? end : next + 1;
+            }
+            if (fields.size() == 1 && fields[0].empty()) continue;      // blank line
+
+            int salary = 0;
+            bool numeric = false;
+            if (fields.size() == 4) {
+                auto result = from_chars(fields[3].data(), fields[3].data() + fields[3].size(), salary);
+                numeric = result.ec == errc() && result.ptr == fields[3].data() + fields[3].size();
+            }
+            if (!numeric) {
+                if (line == 1 && fields.size() == 4) continue;          // header
+                throw runtime_error(path + " line " + to_string(line) + ": expected firstName,lastName,jobTitle,salary");
+            }
+            visit(Employee(intern[0](fields[0]), intern[1](fields[1]), intern[2](fields[2]), salary));
+            rows++;
+        }
+        return rows;
+    }
+
+    // Reads the file at path into a vector, in file order
+    static vector<Employee> read(const string& path) {
+        vector<Employee> roster;
+        read(path, [&roster](Employee&& e) { roster.push_back(std::move(e)); });
+        return roster;
+    }
+
+    /* Writes a header and then [first, last) to path. Returns the number of
+    employees written. */
+    template<typename InputIt>
+    static size_t write(const string& path, InputIt first, InputIt last) {
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) throw runtime_error("Could not write " + path);
+        const string header = "firstName,lastName,jobTitle,salary\n";
+        vector<char> buffer(max(bufferSize, header.size()));
+        size_t used = header.copy(buffer.data(), header.size());
+        size_t rows = 0;
+        for (; first != last; ++first) {
+            const Employee& e = *first;
+            string_view fields[3] = { e.firstName.view(), e.lastName.view(), e.jobTitle.view() };
+            // Room for the worst case: every character a doubled quote
+            size_t longest = 2 * (fields[0].size() + fields[1].size() + fields[2].size()) + 6 + 3 + 12;
+            if (longest > buffer.size() - used) {
+                out.write(buffer.data(), streamsize(used));
+                used = 0;
+                if (longest > buffer.size()) buffer.resize(longest);
+            }
+            char* w = buffer.data() + used;
+            for (string_view field : fields) {
+                w = putField(w, field);
+                *w++ = ',';
+            }
+            w = to_chars(w, w + 11, e.salary).ptr;
+            *w++ = '\n';
+            used = size_t(w - buffer.data());
+            rows++;
+        }
+        out.write(buffer.data(), streamsize(used));
+        out.flush();
+        if (!out) throw runtime_error("Could not write " + path);
+        return rows;
     }
 };
 
@@ -240,6 +2153,7 @@ the same namespace. */
 class UI {
 private:
     EmployeeBST* employees = nullptr;
+    string snapshotPath;        // saved on quit when set
 
     bool isBetween(int num, int* min, int* max) {
         if (min != nullptr && num < *min) return false;
@@ -285,7 +2199,7 @@ private:
     }
 
 public:
-    UI(EmployeeBST* bst): employees(bst) {}
+    UI(EmployeeBST* bst, string snapshotPath = ""): employees(bst), snapshotPath(snapshotPath) {}
 
     void mainMenu() {
         cout << "----------------------------------" << endl;
@@ -309,6 +2223,10 @@ public:
             searchEmployee();
             break;
         case 4:
+            if (!snapshotPath.empty()) {
+                size_t saved = Snapshot::save(snapshotPath, employees->begin(), employees->end());
+                cout << "Saved " << saved << " employees to " << snapshotPath << endl;
+            }
             exit(0);
         default:
             throw runtime_error("How did we get here?!?!\n");
@@ -327,7 +2245,7 @@ public:
         int max = 200000;
         cout << "Select a salary to search for." << endl;
         int salary = inputInteger(&min, &max);
-        vector<Employee> v = employees->findAll(salary);
+        EmployeeSpan v = employees->findAll(salary);
         Employee z;
         int n = v.size();
         if (n == 0) {
@@ -370,6 +2288,165 @@ public:
     }
 };
 
+/* Non-interactive counterpart to UI, for scripts and for replaying a day
+of HR operations at full speed. Reads one tab-separated command per line
+and answers every command with tab-separated lines:
+
+    add <salary> <first> <last> <title>       ok
+    delete <salary> <first> <last> <title>    ok | missing
+    find <salary>                             found <n>, then n records
+    range <min> <max>                         found <n>, then n records
+    name <first|last|title> <name>            found <n>, then n records
+    prefix <first|last|title> <prefix>        found <n>, then n records
+
+Records are written as <salary> <first> <last> <title>. A malformed line
+is answered with "error <line number> <reason>"; blank lines and lines
+starting with # get no answer. Commands are read and answered in batches,
+with one write per batch instead of a flush per line. */
+class BatchUI {
+    EmployeeBST* employees = nullptr;
+    string out;                 // answers for the current batch
+    vector<string_view> fields; // fields of the current line
+    vector<Employee> matches;   // results of the current range or name query
+    size_t lineNumber = 0;
+
+    void split(string_view line) {
+        fields.clear();
+        size_t start = 0;
+        while (true) {
+            size_t tab = line.find('\t', start);
+            fields.push_back(line.substr(start, tab == string_view::npos ? string_view::npos : tab - start));
+            if (tab == string_view::npos) break;
+            start = tab + 1;
+        }
+    }
+
+    static bool parseInt(string_view s, int& value) {
+        auto result = from_chars(s.data(), s.data() + s.size(), value);
+        return result.ec == errc() && result.ptr == s.data() + s.size();
+    }
+
+    static bool parseField(string_view s, NameIndex::field& f) {
+        if (s == "first") f = NameIndex::firstName;
+        else if (s == "last") f = NameIndex::lastName;
+        else if (s == "title") f = NameIndex::jobTitle;
+        else return false;
+        return true;
+    }
+
+    void appendInt(long long value) {
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, result.ptr);
+    }
+
+    void writeRecord(const Employee& e) {
+        appendInt(e.salary);
+        out += '\t';
+        out.append(e.firstName.view());
+        out += '\t';
+        out.append(e.lastName.view());
+        out += '\t';
+        out.append(e.jobTitle.view());
+        out += '\n';
+    }
+
+    void writeFound(size_t n) {
+        out.append("found\t");
+        appendInt((long long)n);
+        out += '\n';
+    }
+
+    void error(const char* reason) {
+        out.append("error\t");
+        appendInt((long long)lineNumber);
+        out += '\t';
+        out.append(reason);
+        out += '\n';
+    }
+
+    // Fields 1 to 4 as an employee; false if the salary is not a number
+    bool parseEmployee(Employee& e) {
+        int salary;
+        if (fields.size() != 5 || !parseInt(fields[1], salary)) return false;
+        e = Employee(fields[2], fields[3], fields[4], salary);
+        return true;
+    }
+
+    void execute(string_view line) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty() || line.front() == '#') return;
+        split(line);
+        string_view command = fields[0];
+        Employee e;
+        int min, max;
+        if (command == "add") {
+            if (!parseEmployee(e)) return error("usage: add <salary> <first> <last> <title>");
+            employees->insert(std::move(e));
+            out.append("ok\n");
+        }
+        else if (command == "delete") {
+            if (!parseEmployee(e)) return error("usage: delete <salary> <first> <last> <title>");
+            if (!employees->contains(e)) {
+                out.append("missing\n");
+                return;
+            }
+            employees->remove(e);
+            out.append("ok\n");
+        }
+        else if (command == "find") {
+            if (fields.size() != 2 || !parseInt(fields[1], min)) return error("usage: find <salary>");
+            EmployeeSpan found = employees->findAll(min);
+            writeFound(found.size());
+            for (const Employee& f : found) writeRecord(f);
+        }
+        else if (command == "range") {
+            if (fields.size() != 3 || !parseInt(fields[1], min) || !parseInt(fields[2], max)) {
+                return error("usage: range <min> <max>");
+            }
+            matches.clear();
+            employees->copyInRange(min, max, back_inserter(matches));
+            writeFound(matches.size());
+            for (const Employee& f : matches) writeRecord(f);
+        }
+        else if (command == "name" || command == "prefix") {
+            NameIndex::field f;
+            if (fields.size() != 3 || !parseField(fields[1], f)) {
+                return error(command == "name" ? "usage: name <first|last|title> <name>" : "usage: prefix <first|last|title> <prefix>");
+            }
+            matches = command == "name" ? employees->findByName(f, fields[2]) : employees->findByPrefix(f, fields[2]);
+            writeFound(matches.size());
+            for (const Employee& m : matches) writeRecord(m);
+        }
+        else {
+            error("unknown command");
+        }
+    }
+
+public:
+    static constexpr size_t batchSize = 4096;   // commands per write
+
+    BatchUI(EmployeeBST* tree) : employees(tree) {}
+
+    void run(istream& in, ostream& os) {
+        string line;
+        bool more = true;
+        while (more) {
+            out.clear();
+            for (size_t i = 0; i < batchSize; i++) {
+                if (!getline(in, line)) {
+                    more = false;
+                    break;
+                }
+                lineNumber++;
+                execute(line);
+            }
+            os.write(out.data(), (streamsize)out.size());
+        }
+        os.flush();
+    }
+};
+
 static string randStr(int length) {
     // Define the list of possible characters
     const string CHARACTERS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
@@ -406,14 +2483,556 @@ static void initializeDummyData(EmployeeBST& bst) {
     uniform_int_distribution<int> salaryDist(30'000, 200'000);
 
     for (int i = 0; i < 10000; i++) {
-        Employee e(randStr(8), randStr(8), randStr(8), salaryDist(gen));
-        bst.insert(e);
+        bst.emplace(randStr(8), randStr(8), randStr(8), salaryDist(gen));
+    }
+}
+
+/* Reproducible benchmarks for this engine. Workloads are generated from
+fixed seeds, so Employee_Info_BST and Employee_Info_RB_Tree time exactly
+the same operations on exactly the same data and their reports can be
+compared row by row. Peak RSS is the high-water mark of the whole
+process, so run one size per process when comparing memory. */
+class Benchmark {
+public:
+    enum distribution { uniform, sorted, reverseSorted, duplicates };
+
+    static const char* name(distribution d) {
+        switch (d) {
+        case sorted: return "sorted";
+        case reverseSorted: return "reverse";
+        case duplicates: return "duplicates";
+        default: return "uniform";
+        }
+    }
+
+    /* n employees with salaries in [30000, 200000] drawn from d. The
+    duplicates distribution only uses 100 distinct salaries. Names come
+    from fixed pools so they repeat the way they do in a real roster. */
+    static vector<Employee> workload(size_t n, distribution d, unsigned seed = 42) {
+        mt19937 gen(seed);
+        vector<InternedString> firstNames = namePool(gen, 2'000);
+        vector<InternedString> lastNames = namePool(gen, 20'000);
+        vector<InternedString> titles = namePool(gen, 300);
+        uniform_int_distribution<int> salaryDist(30'000, 200'000);
+        uniform_int_distribution<int> bandDist(0, 99);
+
+        vector<Employee> roster;
+        roster.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            int salary = (d == duplicates) ? 30'000 + bandDist(gen) * 1'700 : salaryDist(gen);
+            roster.emplace_back(firstNames[gen() % firstNames.size()], lastNames[gen() % lastNames.size()],
+                titles[gen() % titles.size()], salary);
+        }
+        if (d == sorted) stable_sort(roster.begin(), roster.end());
+        if (d == reverseSorted) stable_sort(roster.begin(), roster.end(), greater<Employee>());
+        return roster;
+    }
+
+    // Largest resident set size the process has reached, in bytes
+    static size_t peakRss() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+        return counters.PeakWorkingSetSize;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+        return (size_t)usage.ru_maxrss;
+#else
+        return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+    }
+
+    /* Runs insert, find, findAll, range, remove and teardown for every size
+    and distribution and prints one row per operation. A case whose inserts
+    take longer than budgetSeconds (the unbalanced BST on sorted input) is
+    cut short and reported as such instead of running for hours. */
+    static void suite(const vector<size_t>& sizes, double budgetSeconds) {
+        cout << left << setw(12) << "engine" << setw(12) << "workload" << right << setw(10) << "employees"
+            << "  " << left << setw(9) << "operation" << right << setw(10) << "ops" << setw(12) << "ns/op"
+            << setw(14) << "ops/s" << setw(12) << "peak RSS MB" << '\n';
+        for (size_t n : sizes) {
+            for (distribution d : { uniform, sorted, reverseSorted, duplicates }) {
+                runCase(n, d, budgetSeconds);
+            }
+        }
+        cout.flush();
+    }
+
+    /* Times bulkLoad of count unsorted employees, then findInRange and
+    printInRange (formatted, then thrown away) over all of them, on 1, 2,
+    4, ... threads of the shared WorkerPool, up to one per core. */
+    static void parallelScans(size_t count) {
+        vector<Employee> roster = workload(count, uniform);
+        WorkerPool& pool = WorkerPool::shared();
+        size_t cores = pool.size();
+        cout << "Bulk build and full-range scans of " << count << " employees\n";
+        cout << right << setw(10) << "threads" << setw(14) << "bulkLoad ms" << setw(14) << "find ms"
+            << setw(14) << "print ms" << setw(10) << "speedup" << '\n';
+        double single = 0;
+        for (size_t threads = 1;; threads = min(threads * 2, cores)) {
+            pool.limit(threads);
+            EmployeeBST tree;
+            auto start = chrono::steady_clock::now();
+            tree.bulkLoad(roster);
+            double build = elapsedNs(start);
+            start = chrono::steady_clock::now();
+            vector<Employee> all = tree.findInRange(INT_MIN, INT_MAX);
+            double find = elapsedNs(start);
+            ostream discard(nullptr);
+            start = chrono::steady_clock::now();
+            tree.printInRange(INT_MIN, INT_MAX, discard);
+            double print = elapsedNs(start);
+            if (threads == 1) single = build + find + print;
+            cout << setw(10) << threads << fixed << setprecision(1) << setw(14) << build / 1e6 << setw(14) << find / 1e6
+                << setw(14) << print / 1e6 << setprecision(2) << setw(10) << single / (build + find + print) << '\n';
+            if (all.size() != count) cout << "  (found " << all.size() << " employees)\n";
+            if (threads == cores) break;
+        }
+        pool.limit(cores);
+        cout.flush();
+    }
+
+    /* Writes count employees to a CSV file at path and reads them back,
+    reporting the throughput of Csv::write, Csv::read and of bulkLoad on
+    what was read. */
+    static void csv(size_t count, const string& path) {
+        vector<Employee> roster = workload(count, uniform);
+        auto show = [](const char* label, size_t bytes, double ns) {
+            cout << "  " << setw(12) << left << label << right << fixed << setprecision(1) << setw(10) << ns / 1e6
+                << " ms" << setw(10) << (bytes / (1024.0 * 1024.0)) / (ns / 1e9) << " MB/s\n";
+        };
+
+        auto start = chrono::steady_clock::now();
+        Csv::write(path, roster.begin(), roster.end());
+        double writeNs = elapsedNs(start);
+        size_t bytes = 0;
+        {
+            ifstream probe(path, ios::binary | ios::ate);
+            bytes = size_t(probe.tellg());
+        }
+        cout << "CSV round trip of " << count << " employees, " << fixed << setprecision(1)
+            << bytes / (1024.0 * 1024.0) << " MB at " << path << '\n';
+        show("write", bytes, writeNs);
+
+        start = chrono::steady_clock::now();
+        vector<Employee> loaded = Csv::read(path);
+        show("read", bytes, elapsedNs(start));
+
+        EmployeeBST tree;
+        start = chrono::steady_clock::now();
+        tree.bulkLoad(loaded);
+        show("bulkLoad", bytes, elapsedNs(start));
+        if (loaded != roster) cout << "  read back a different roster\n";
+        std::remove(path.c_str());
+    }
+
+    /* Times random salary lookups against EmployeeBST::search and against a SalaryIndex
+    of the same employees under every KeySearch kernel this CPU supports. */
+    static void keySearch(size_t count) {
+        vector<Employee> roster = workload(count, uniform);
+        EmployeeBST tree;
+        tree.bulkLoad(roster);
+        SalaryIndex index(tree.begin(), tree.end());
+        vector<int> queries = probes(1'000'000);
+
+        auto time = [&](const string& label, auto lookup) {
+            size_t hits = 0;
+            auto start = chrono::steady_clock::now();
+            for (int q : queries) hits += (lookup(q) != nullptr);
+            double ns = elapsedNs(start);
+            cout << "  " << setw(30) << left << label << right << fixed << setprecision(1)
+                << ns / queries.size() << " ns/lookup (" << hits << " hits)\n";
+        };
+
+        cout << "Salary lookups over " << count << " employees\n";
+        time("EmployeeBST::search", [&](int q) { return tree.search(q); });
+        KeySearch::kernel best = KeySearch::detect();
+        for (int k = KeySearch::scalar; k <= best; k++) {
+            KeySearch::use(KeySearch::kernel(k));
+            time(string("SalaryIndex::find (") + KeySearch::name(KeySearch::kernel(k)) + ")",
+                [&](int q) { return index.find(q); });
+        }
+        KeySearch::use(best);
+    }
+
+    /* Times batch lookups, inserts and removes of batch employees against
+    the same number of single calls, on two copies of a tree of count. */
+    static void batchOperations(size_t count, size_t batch) {
+        vector<Employee> roster = workload(count, uniform);
+        vector<Employee> extra = workload(batch, uniform, 9);
+        vector<int> lookups = probes(batch);
+        EmployeeBST single, batched;
+        single.bulkLoad(roster);
+        batched.bulkLoad(roster);
+
+        auto time = [&](const char* operation, auto one, auto all) {
+            auto start = chrono::steady_clock::now();
+            size_t sum = one();
+            double singleNs = elapsedNs(start);
+            start = chrono::steady_clock::now();
+            size_t batchSum = all();
+            double batchNs = elapsedNs(start);
+            cout << "  " << setw(8) << left << operation << right << fixed << setprecision(1)
+                << setw(14) << singleNs / batch << setw(14) << batchNs / batch
+                << (sum == batchSum ? "" : "  (results differ)") << '\n';
+        };
+
+        cout << "Batches of " << batch << " over " << count << " employees, ns/op\n";
+        cout << "  " << setw(8) << left << "" << right << setw(14) << "one by one" << setw(14) << "batched" << '\n';
+        time("find", [&] {
+            size_t n = 0;
+            for (int q : lookups) n += single.findAll(q).size();
+            return n;
+        }, [&] {
+            size_t n = 0;
+            for (const EmployeeSpan& found : batched.findBatch(lookups)) n += found.size();
+            return n;
+        });
+        time("insert", [&] {
+            for (const Employee& e : extra) single.insert(e);
+            return extra.size();
+        }, [&] {
+            batched.insertBatch(extra);
+            return extra.size();
+        });
+        time("remove", [&] {
+            for (const Employee& e : extra) single.remove(e);
+            return extra.size();
+        }, [&] {
+            return batched.removeBatch(extra);
+        });
+        cout.flush();
+    }
+
+    /* Times lookups by last name and by job title prefix over count
+    employees, first by scanning the tree and then through a NameIndex,
+    and what keeping all three indexes up to date adds to each insert and
+    remove. */
+    static void nameLookups(size_t count) {
+        vector<Employee> roster = workload(count, uniform);
+        const NameIndex::field allFields[] = { NameIndex::firstName, NameIndex::lastName, NameIndex::jobTitle };
+        EmployeeBST tree;
+        tree.bulkLoad(roster);
+        mt19937 gen(7);
+        vector<string> names, prefixes;
+        for (int i = 0; i < 1000; i++) {
+            const Employee& e = roster[gen() % roster.size()];
+            names.emplace_back(e.lastName.view());
+            prefixes.emplace_back(e.jobTitle.view().substr(0, 2));
+        }
+
+        // Scans are timed over the first few queries only
+        auto time = [&](const string& label, const vector<string>& queries, size_t limit, auto lookup) {
+            size_t n = min(limit, queries.size()), found = 0;
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < n; i++) found += lookup(queries[i]).size();
+            double ns = elapsedNs(start);
+            cout << "  " << setw(32) << left << label << right << fixed << setprecision(1)
+                << ns / n / 1000 << " us/query (" << found / n << " matches each)\n";
+        };
+        auto byName = [&tree](const string& q) { return tree.findByName(NameIndex::lastName, q); };
+        auto byPrefix = [&tree](const string& q) { return tree.findByPrefix(NameIndex::jobTitle, q); };
+
+        cout << "Name lookups over " << count << " employees\n";
+        time("findByName(lastName), scan", names, 20, byName);
+        time("findByPrefix(jobTitle), scan", prefixes, 20, byPrefix);
+        auto start = chrono::steady_clock::now();
+        for (NameIndex::field f : allFields) tree.addIndex(f);
+        cout << "  " << setw(32) << left << "addIndex, all three fields" << right << fixed << setprecision(1)
+            << elapsedNs(start) / 1e6 << " ms\n";
+        time("findByName(lastName), indexed", names, names.size(), byName);
+        time("findByPrefix(jobTitle), indexed", prefixes, prefixes.size(), byPrefix);
+
+        // Fills a fresh tree, then empties it in random order; ns per insert and per remove
+        vector<size_t> order(roster.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        shuffle(order.begin(), order.end(), gen);
+        auto churn = [&](bool indexed) {
+            EmployeeBST fresh;
+            if (indexed) for (NameIndex::field f : allFields) fresh.addIndex(f);
+            auto start = chrono::steady_clock::now();
+            for (const Employee& e : roster) fresh.insert(e);
+            double insert = elapsedNs(start) / roster.size();
+            start = chrono::steady_clock::now();
+            for (size_t i : order) fresh.remove(roster[i]);
+            return make_pair(insert, elapsedNs(start) / roster.size());
+        };
+        pair<double, double> plain = churn(false), indexed = churn(true);
+        cout << "  " << setw(32) << left << "insert, no indexes" << right << plain.first << " ns/op\n";
+        cout << "  " << setw(32) << left << "insert, all three indexes" << right << indexed.first << " ns/op\n";
+        cout << "  " << setw(32) << left << "remove, no indexes" << right << plain.second << " ns/op\n";
+        cout << "  " << setw(32) << left << "remove, all three indexes" << right << indexed.second << " ns/op\n";
+        cout.flush();
+    }
+
+    /* Times removing specific employees from the duplicates workload, where
+    thousands of employees share each salary, with ties kept in insertion
+    order and in key order. */
+    static void tieRemovals(size_t count) {
+        vector<Employee> roster = workload(count, duplicates);
+        vector<size_t> victims(count);
+        for (size_t i = 0; i < count; i++) victims[i] = i;
+        shuffle(victims.begin(), victims.end(), mt19937(11));
+        victims.resize(min<size_t>(count / 2, 100'000));
+
+        cout << "Removing " << victims.size() << " of " << count << " employees on 100 salaries\n";
+        for (EmployeeBST::tieOrder order : { EmployeeBST::insertionOrder, EmployeeBST::keyOrder }) {
+            EmployeeBST tree;
+            tree.orderTies(order);
+            auto start = chrono::steady_clock::now();
+            tree.bulkLoad(roster);
+            double load = elapsedNs(start);
+            start = chrono::steady_clock::now();
+            for (size_t i : victims) tree.remove(roster[i]);
+            double remove = elapsedNs(start);
+            cout << "  " << setw(16) << left << (order == EmployeeBST::keyOrder ? "keyOrder" : "insertionOrder") << right
+                << fixed << setprecision(1) << setw(10) << load / 1e6 << " ms bulkLoad"
+                << setw(12) << remove / victims.size() << " ns/remove\n";
+        }
+        cout.flush();
+    }
+
+private:
+    static vector<InternedString> namePool(mt19937& gen, size_t count) {
+        const string CHARACTERS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+        vector<InternedString> pool;
+        pool.reserve(count);
+        string name(8, ' ');
+        for (size_t i = 0; i < count; i++) {
+            for (char& c : name) c = CHARACTERS[gen() % CHARACTERS.size()];
+            pool.emplace_back(name);
+        }
+        return pool;
+    }
+
+    // Salaries to look up, the same for every engine and workload
+    static vector<int> probes(size_t count) {
+        mt19937 gen(7);
+        uniform_int_distribution<int> salaryDist(30'000, 200'000);
+        vector<int> out(count);
+        for (int& p : out) p = salaryDist(gen);
+        return out;
+    }
+
+    static double elapsedNs(chrono::steady_clock::time_point start) {
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    }
+
+    static void report(distribution d, size_t n, const char* operation, size_t ops, double ns) {
+        double perOp = ops == 0 ? 0 : ns / ops;
+        cout << left << setw(12) << "EmployeeBST" << setw(12) << name(d) << right << setw(10) << n
+            << "  " << left << setw(9) << operation << right << setw(10) << ops
+            << fixed << setprecision(1) << setw(12) << perOp
+            << setprecision(0) << setw(14) << (perOp == 0 ? 0 : 1e9 / perOp)
+            << setprecision(1) << setw(12) << peakRss() / (1024.0 * 1024.0) << '\n';
+    }
+
+    static void runCase(size_t n, distribution d, double budgetSeconds) {
+        vector<Employee> roster = workload(n, d);
+        vector<int> lookups = probes(min<size_t>(n, 1'000'000));
+        unique_ptr<EmployeeBST> tree = make_unique<EmployeeBST>();
+
+        auto start = chrono::steady_clock::now();
+        size_t inserted = 0;
+        for (const Employee& e : roster) {
+            tree->insert(e);
+            if (++inserted % 1024 == 0 && elapsedNs(start) > budgetSeconds * 1e9) break;
+        }
+        report(d, n, "insert", inserted, elapsedNs(start));
+        if (inserted < n) {
+            cout << "  insert exceeded the " << budgetSeconds << "s budget; skipping the rest of this case\n";
+            cout.flush();
+            return;
+        }
+
+        size_t hits = 0;
+        start = chrono::steady_clock::now();
+        for (int q : lookups) hits += (tree->search(q) != nullptr);
+        report(d, n, "find", lookups.size(), elapsedNs(start));
+
+        start = chrono::steady_clock::now();
+        for (int q : lookups) hits += tree->findAll(q).size();
+        report(d, n, "findAll", lookups.size(), elapsedNs(start));
+
+        // Narrow salary bands of 1000, a tenth as many as the point lookups.
+        // Every match is read so the visit cannot be optimized away.
+        size_t bands = max<size_t>(1, lookups.size() / 10);
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < bands; i++) {
+            tree->forEachInRange(lookups[i], lookups[i] + 999, [&hits](const Employee& e) { hits += e.salary; });
+        }
+        report(d, n, "range", bands, elapsedNs(start));
+
+        vector<size_t> victims(n);
+        for (size_t i = 0; i < n; i++) victims[i] = i;
+        shuffle(victims.begin(), victims.end(), mt19937(11));
+        victims.resize(min<size_t>(n / 2, 100'000));    // leave the rest for teardown
+        start = chrono::steady_clock::now();
+        for (size_t i : victims) tree->remove(roster[i]);
+        report(d, n, "remove", victims.size(), elapsedNs(start));
+
+        start = chrono::steady_clock::now();
+        tree.reset();
+        report(d, n, "teardown", n - victims.size(), elapsedNs(start));
+        if (hits == 0) cout << "  (no lookups matched)\n";
+        cout.flush();
+    }
+};
+
+// Replaces the contents of bst with the snapshot at path. Returns false
+// if there is no snapshot there yet.
+static bool loadSnapshot(EmployeeBST& bst, const string& path) {
+    Snapshot snapshot;
+    try {
+        if (!snapshot.open(path)) return false;
+    }
+    catch (const runtime_error& e) {
+        cerr << e.what() << endl;
+        exit(1);                        // refuse to run, and later overwrite, a file we cannot read
+    }
+    bst.bulkLoad(snapshot.employees());
+    cerr << "Loaded " << snapshot.size() << " employees from " << path << endl;
+    return true;
+}
+
+// Adds every employee in the CSV file at path to bst.
+static void importCsv(EmployeeBST& bst, const string& path) {
+    try {
+        auto start = chrono::steady_clock::now();
+        vector<Employee> roster = Csv::read(path);
+        bst.bulkLoad(roster);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cerr << "Imported " << roster.size() << " employees from " << path << " in " << seconds << " s" << endl;
+    }
+    catch (const runtime_error& e) {
+        cerr << e.what() << endl;
+        exit(1);
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    vector<string> args(argv + 1, argv + argc);
+    string csvPath;                     // --csv <file> [mode...]: add the roster in a CSV file at start
+    string snapshotPath;                // --snapshot <file> [mode...]: load at start, save at exit
+    while (args.size() >= 2 && (args[0] == "--snapshot" || args[0] == "--csv")) {
+        (args[0] == "--snapshot" ? snapshotPath : csvPath) = args[1];
+        args.erase(args.begin(), args.begin() + 2);
+    }
+    string mode = args.empty() ? "" : args[0];
+    if (mode == "--bench") {            // --bench [budget seconds] [employees...]
+        double budget = args.size() > 1 ? stod(args[1]) : 30;
+        vector<size_t> sizes;
+        for (size_t i = 2; i < args.size(); i++) sizes.push_back(stoul(args[i]));
+        if (sizes.empty()) sizes = { 10'000, 1'000'000, 10'000'000 };
+        Benchmark::suite(sizes, budget);
+        return 0;
+    }
+    if (mode == "--bench-parallel") {   // --bench-parallel [employees]
+        Benchmark::parallelScans(args.size() > 1 ? stoul(args[1]) : 1'000'000);
+        return 0;
+    }
+    if (mode == "--bench-search") {     // --bench-search [employees]
+        Benchmark::keySearch(args.size() > 1 ? stoul(args[1]) : 1'000'000);
+        return 0;
+    }
+    if (mode == "--bench-batch") {      // --bench-batch [employees] [batch size]
+        Benchmark::batchOperations(args.size() > 1 ? stoul(args[1]) : 1'000'000, args.size() > 2 ? stoul(args[2]) : 50'000);
+        return 0;
+    }
+    if (mode == "--bench-names") {      // --bench-names [employees]
+        Benchmark::nameLookups(args.size() > 1 ? stoul(args[1]) : 1'000'000);
+        return 0;
+    }
+    if (mode == "--bench-ties") {       // --bench-ties [employees]
+        Benchmark::tieRemovals(args.size() > 1 ? stoul(args[1]) : 1'000'000);
+        return 0;
+    }
+    if (mode == "--bench-csv") {        // --bench-csv [employees] [file]
+        Benchmark::csv(args.size() > 1 ? stoul(args[1]) : 1'000'000, args.size() > 2 ? args[2] : "bench.csv");
+        return 0;
+    }
+    if (mode == "--snapshot-query") {   // --snapshot-query <file> <min> <max>, straight from the mapping
+        if (args.size() < 4) {
+            cerr << "Usage: --snapshot-query <file> <min salary> <max salary>" << endl;
+            return 1;
+        }
+        Snapshot snapshot;
+        try {
+            if (!snapshot.open(args[1])) {
+                cerr << "Could not open " << args[1] << endl;
+                return 1;
+            }
+        }
+        catch (const runtime_error& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        ios::sync_with_stdio(false);
+        snapshot.printInRange(stoi(args[2]), stoi(args[3]));
+        return 0;
+    }
+    if (mode == "--export-csv") {       // --export-csv <file>: the roster from --snapshot and --csv, in salary order
+        if (args.size() < 2) {
+            cerr << "Usage: --export-csv <file>" << endl;
+            return 1;
+        }
+        EmployeeBST bst;
+        if (!snapshotPath.empty()) {
+            loadSnapshot(bst, snapshotPath);
+        }
+        if (!csvPath.empty()) importCsv(bst, csvPath);
+        try {
+            size_t rows = Csv::write(args[1], bst.begin(), bst.end());
+            cerr << "Exported " << rows << " employees to " << args[1] << endl;
+        }
+        catch (const runtime_error& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (mode == "--batch") {            // --batch [command file], stdin if omitted or -
+        ios::sync_with_stdio(false);
+        cin.tie(nullptr);
+        EmployeeBST bst;
+        if (!snapshotPath.empty()) loadSnapshot(bst, snapshotPath);
+        if (!csvPath.empty()) importCsv(bst, csvPath);
+        bst.orderTies(EmployeeBST::keyOrder);
+        for (NameIndex::field f : { NameIndex::firstName, NameIndex::lastName, NameIndex::jobTitle }) bst.addIndex(f);
+        BatchUI batch(&bst);
+        string path = args.size() > 1 ? args[1] : "-";
+        if (path == "-") {
+            batch.run(cin, cout);
+        }
+        else {
+            ifstream commands(path);
+            if (!commands) {
+                cerr << "Could not open " << path << endl;
+                return 1;
+            }
+            batch.run(commands, cout);
+        }
+        if (!snapshotPath.empty()) Snapshot::save(snapshotPath, bst.begin(), bst.end());
+        return 0;
+    }
     EmployeeBST bst;
-    UI ui = UI(&bst);
+    UI ui = UI(&bst, snapshotPath);
+    bool loaded = !snapshotPath.empty() && loadSnapshot(bst, snapshotPath);
+    if (!csvPath.empty()) {
+        importCsv(bst, csvPath);
+        loaded = true;
+    }
+    if (loaded) {
+        cout << "Welcome back to the employee \"Database\"" << endl;
+        while (true) ui.mainMenu();
+    }
+    if (!snapshotPath.empty()) {        // a snapshot that does not exist yet starts an empty session
+        cout << "Welcome to the employee \"Database\"" << endl;
+        while (true) ui.mainMenu();
+    }
     cout << "~~~ Inserting Evan, Thor, and Jonah ~~~" << endl;
     bst.insert(Employee("evan", "whitmer", "frontend developer", 199999));
     bst.insert(Employee("jonah", "ebent", "retired", 200000));
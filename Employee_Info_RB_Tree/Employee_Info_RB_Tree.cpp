@@ -36,26 +36,188 @@ RB Tree Properties
 
 Much of the implementation was taken from https://www.programiz.com/dsa/red-black-tree
 */
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <random>
+#include <shared_mutex>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// SIMD key search (see KeySearch) is only compiled for x86 targets.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define EMPLOYEE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define EMPLOYEE_X86 0
+#endif
+
+// gcc and clang only emit vector instructions in functions marked for them
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
 using namespace std;
 
+/* Interns strings into one table shared by the whole program, so equal
+strings are stored once and referred to by a 32-bit id. The characters
+live back to back in large blocks instead of one heap block per string.
+Ids are never reclaimed; the table only grows. */
+class StringPool {
+    static constexpr size_t blockSize = 1 << 20;
+    static constexpr size_t chunkSize = 1 << 16;  // ids per chunk of the id table
+
+    vector<unique_ptr<char[]>> blocks;
+    size_t blockUsed = 0;
+    // id -> characters. The chunk list is reserved up front and chunks never
+    // move, so view() can read any id it was handed without taking the lock.
+    vector<unique_ptr<string_view[]>> chunks;
+    uint32_t count = 0;
+    size_t bytes = 0;
+    unordered_map<string_view, uint32_t> ids;
+    mutex lock;
+
+    StringPool() {
+        chunks.reserve((size_t(UINT32_MAX) + 1) / chunkSize);
+        intern("");     // id 0 is the empty string
+    }
+
+    // Copies s into the character blocks and returns the stored copy.
+    string_view store(string_view s) {
+        if (blocks.empty() || s.size() > blockSize - blockUsed) {
+            blocks.emplace_back(new char[max(blockSize, s.size())]);
+            blockUsed = 0;
+            bytes += max(blockSize, s.size());
+        }
+        char* p = blocks.back().get() + blockUsed;
+        copy(s.begin(), s.end(), p);
+        blockUsed += s.size();
+        return string_view(p, s.size());
+    }
+
+public:
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    static StringPool& shared() {
+        static StringPool pool;
+        return pool;
+    }
+
+    uint32_t intern(string_view s) {
+        lock_guard<mutex> guard(lock);
+        auto found = ids.find(s);
+        if (found != ids.end()) return found->second;
+        if (count % chunkSize == 0) chunks.emplace_back(new string_view[chunkSize]);
+        string_view stored = store(s);
+        chunks.back()[count % chunkSize] = stored;
+        ids.emplace(stored, count);
+        return count++;
+    }
+
+    // Looks s up without interning it; false if it has never been interned
+    bool find(string_view s, uint32_t& id) {
+        lock_guard<mutex> guard(lock);
+        auto found = ids.find(s);
+        if (found == ids.end()) return false;
+        id = found->second;
+        return true;
+    }
+
+    string_view view(uint32_t id) const {
+        return chunks[id / chunkSize][id % chunkSize];
+    }
+
+    // Number of distinct strings interned so far
+    size_t size() const { return count; }
+
+    // Bytes held for characters, not counting the id table or hash index
+    size_t bytesReserved() const { return bytes; }
+};
+
+/* A 4-byte handle to a string in the shared StringPool. Equal strings
+always get the same id, so equality is a single integer compare. */
+class InternedString {
+    uint32_t index = 0;
+
+public:
+    InternedString() {}
+    InternedString(string_view s) : index(StringPool::shared().intern(s)) {}
+    InternedString(const string& s) : InternedString(string_view(s)) {}
+    InternedString(const char* s) : InternedString(string_view(s)) {}
+
+    uint32_t id() const { return index; }
+    string_view view() const { return StringPool::shared().view(index); }
+    string str() const { return string(view()); }
+    bool empty() const { return index == 0; }
+
+    bool operator==(const InternedString& other) const { return index == other.index; }
+    bool operator!=(const InternedString& other) const { return index != other.index; }
+
+    // Orders by the characters, not by the order strings were interned in
+    bool operator<(const InternedString& other) const { return view() < other.view(); }
+
+    friend ostream& operator<<(ostream& os, const InternedString& obj) {
+        return os << obj.view();
+    }
+};
+
+/* One employee: the salary plus three handles into the shared StringPool,
+16 bytes in all, with no heap blocks of its own. */
 struct Employee {
     Employee() {};
-    Employee(string firstName, string lastName, string jobTitle, int salary) :
+    Employee(InternedString firstName, InternedString lastName, InternedString jobTitle, int salary) :
         firstName(firstName),
         lastName(lastName),
         jobTitle(jobTitle),
         salary(salary) {}
 
     int salary{};
-    string firstName{};
-    string lastName{};
-    string jobTitle{};
+    InternedString firstName{};
+    InternedString lastName{};
+    InternedString jobTitle{};
 
     bool operator<(const Employee& other) const {
         return salary < other.salary;
@@ -90,34 +252,597 @@ struct Employee {
     }
 };
 
+/* A total order on employees: by salary, then by last name, first name
+and job title, comparing their characters. Unlike operator<, it only
+calls two employees equivalent when operator== calls them equal. */
+struct EmployeeKeyLess {
+    bool operator()(const Employee& a, const Employee& b) const {
+        if (a.salary != b.salary) return a.salary < b.salary;
+        if (a.lastName != b.lastName) return a.lastName < b.lastName;
+        if (a.firstName != b.firstName) return a.firstName < b.firstName;
+        return a.jobTitle < b.jobTitle;
+    }
+};
+
+/* A read-only view of a contiguous run of employees, such as every
+employee stored under one salary. */
+struct EmployeeSpan {
+    EmployeeSpan() {}
+    EmployeeSpan(const Employee* first, size_t count) : first(first), count(count) {}
+
+    const Employee* first = nullptr;
+    size_t count = 0;
+
+    const Employee* begin() const { return first; }
+    const Employee* end() const { return first + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const Employee& operator[](size_t i) const { return first[i]; }
+
+    const Employee& at(size_t i) const {
+        if (i >= count) throw out_of_range("EmployeeSpan::at");
+        return first[i];
+    }
+};
+
+/* Allocation counters kept by every NodeAllocator, so the effect of a
+pooling strategy can be measured from the outside. */
+struct AllocatorStats {
+    size_t allocations = 0;         // blocks handed out to the tree
+    size_t deallocations = 0;       // blocks given back by the tree
+    size_t released = 0;            // blocks still in use when release() dropped their slabs
+    size_t systemAllocations = 0;   // calls made to the global operator new
+    size_t bytesReserved = 0;       // bytes currently held from the system
+
+    size_t blocksInUse() const { return allocations - deallocations - released; }
+};
+
+/* Head count and payroll of a salary band, from EmployeeRBT::summarize.
+lowest and highest are 0 when the band is empty. */
+struct SalaryStats {
+    size_t count = 0;
+    long long total = 0;            // sum of the salaries
+    int lowest = 0;
+    int highest = 0;
+
+    double average() const { return count == 0 ? 0 : double(total) / count; }
+};
+
+/* Where a tree gets the memory for its nodes. A tree owns its allocator,
+so each tree can pick its own strategy. */
+class NodeAllocator {
+public:
+    virtual ~NodeAllocator() {}
+
+    virtual void* allocate(size_t size) = 0;
+    virtual void deallocate(void* p, size_t size) = 0;
+
+    // Whether release() can drop every block at once, letting the tree
+    // skip handing nodes back one at a time when it is torn down.
+    virtual bool canRelease() const { return false; }
+    virtual void release() {}
+
+    const AllocatorStats& stats() const { return counters; }
+
+protected:
+    AllocatorStats counters;
+};
+
+// One global new/delete per node.
+class HeapAllocator : public NodeAllocator {
+public:
+    void* allocate(size_t size) override {
+        counters.allocations++;
+        counters.systemAllocations++;
+        counters.bytesReserved += size;
+        return ::operator new(size);
+    }
+
+    void deallocate(void* p, size_t size) override {
+        counters.deallocations++;
+        counters.bytesReserved -= size;
+        ::operator delete(p);
+    }
+};
+
+/* Carves nodes out of large slabs and recycles removed nodes through an
+intrusive free list. Every block in a pool has the size of the first
+request, which is fine since a tree only ever allocates one node type. */
+class PoolAllocator : public NodeAllocator {
+    struct freeBlock {
+        freeBlock* next;
+    };
+
+    size_t blocksPerSlab;
+    size_t blockSize = 0;
+    vector<void*> slabs;
+    freeBlock* freeList = nullptr;
+    char* cursor = nullptr;     // next unused block in the newest slab
+    char* limit = nullptr;      // end of the newest slab
+
+public:
+    PoolAllocator(size_t blocksPerSlab = 4096) : blocksPerSlab(blocksPerSlab) {}
+
+    PoolAllocator(const PoolAllocator&) = delete;
+    PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+    ~PoolAllocator() override {
+        release();
+    }
+
+    void* allocate(size_t size) override {
+        if (blockSize == 0) {   // round up so every block stays aligned
+            const size_t align = alignof(max_align_t);
+            blockSize = (max(size, sizeof(freeBlock)) + align - 1) / align * align;
+        }
+        else if (size > blockSize) {
+            throw invalid_argument("PoolAllocator only serves blocks of one size");
+        }
+        counters.allocations++;
+        if (freeList != nullptr) {
+            freeBlock* b = freeList;
+            freeList = b->next;
+            return b;
+        }
+        if (cursor == limit) {
+            size_t bytes = blockSize * blocksPerSlab;
+            cursor = static_cast<char*>(::operator new(bytes));
+            limit = cursor + bytes;
+            slabs.push_back(cursor);
+            counters.systemAllocations++;
+            counters.bytesReserved += bytes;
+        }
+        void* p = cursor;
+        cursor += blockSize;
+        return p;
+    }
+
+    void deallocate(void* p, size_t) override {
+        counters.deallocations++;
+        freeBlock* b = static_cast<freeBlock*>(p);
+        b->next = freeList;
+        freeList = b;
+    }
+
+    bool canRelease() const override { return true; }
+
+    // Hands every slab back to the system, whether or not its blocks were
+    // freed. Blocks the tree never gave back are counted as released, not
+    // as deallocations, so the stats still show how many there were.
+    void release() override {
+        for (void* slab : slabs) ::operator delete(slab);
+        slabs.clear();
+        freeList = nullptr;
+        cursor = limit = nullptr;
+        counters.released += counters.blocksInUse();
+        counters.bytesReserved = 0;
+    }
+};
+
+/* Worker threads shared by the whole program, for splitting one large job,
+such as a bulk build or a full payroll report, across the cores. run()
+hands tasks out through a shared counter, so a thread that finishes early
+takes the next task instead of idling; with several tasks per thread that
+evens out uneven work the way work stealing would, without a queue per
+thread. The calling thread works too. One job runs at a time: a run() that
+finds the pool busy, including one made from inside a task, does all its
+tasks itself. */
+class WorkerPool {
+    vector<thread> workers;
+    size_t active;              // threads that take part in a job, counting the caller
+
+    mutex lock;                 // guards everything below
+    condition_variable wake, done;
+    function<void(size_t)> job;
+    size_t jobTasks = 0;
+    atomic<size_t> nextTask{ 0 };
+    uint64_t generation = 0;    // bumped for every job
+    size_t busy = 0;            // workers still on the current job
+    bool stopping = false;
+    mutex running;              // held by the caller of the job in progress
+
+    WorkerPool(size_t threads) : active(threads) {
+        for (size_t i = 1; i < threads; i++) workers.emplace_back([this, i] { work(i); });
+    }
+
+    // Set on a thread for as long as it runs tasks. std::mutex cannot be
+    // tried by a thread that already holds it, so nested run()s check this.
+    static bool& inTask() {
+        thread_local bool flag = false;
+        return flag;
+    }
+
+    // Takes tasks until there are none left
+    void drain() {
+        for (size_t i = nextTask++; i < jobTasks; i = nextTask++) job(i);
+    }
+
+    void work(size_t index) {
+        inTask() = true;
+        uint64_t seen = 0;
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            guard.unlock();
+            if (index < active) drain();
+            guard.lock();
+            if (--busy == 0) done.notify_one();
+        }
+    }
+
+public:
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& w : workers) w.join();
+    }
+
+    // One thread per core
+    static WorkerPool& shared() {
+        static WorkerPool pool(max(1u, thread::hardware_concurrency()));
+        return pool;
+    }
+
+    // Threads that take part in a job, counting the caller
+    size_t size() const { return active; }
+
+    // Lets only the first threads of the pool take part, e.g. to time a
+    // job on fewer cores. Must not be called while a job is running.
+    void limit(size_t threads) {
+        lock_guard<mutex> guard(running);
+        active = min(max<size_t>(threads, 1), workers.size() + 1);
+    }
+
+    // Calls work(i) for every i in [0, tasks), in any order and on any of
+    // the pool's threads, and returns once every call has.
+    template<typename Work>
+    void run(size_t tasks, Work work) {
+        unique_lock<mutex> exclusive;
+        if (!inTask() && active > 1 && tasks > 1) exclusive = unique_lock<mutex>(running, try_to_lock);
+        if (!exclusive.owns_lock()) {
+            for (size_t i = 0; i < tasks; i++) work(i);
+            return;
+        }
+        unique_lock<mutex> guard(lock);
+        job = work;
+        jobTasks = tasks;
+        nextTask = 0;
+        busy = workers.size();
+        generation++;
+        guard.unlock();
+        wake.notify_all();
+        inTask() = true;
+        drain();
+        inTask() = false;
+        guard.lock();
+        done.wait(guard, [this] { return busy == 0; });
+        job = nullptr;
+    }
+};
+
+/* stable_sort by salary, split across the shared WorkerPool for large
+inputs: each thread sorts a slice, then the slices are merged pairwise,
+every merge itself cut into pieces at matching salaries so the last
+rounds keep all the threads busy too. */
+static void parallelStableSort(vector<Employee>& v) {
+    WorkerPool& pool = WorkerPool::shared();
+    const size_t minParallel = 1 << 16;
+    if (pool.size() == 1 || v.size() < minParallel) {
+        stable_sort(v.begin(), v.end());
+        return;
+    }
+    size_t slices = 1;
+    while (slices < pool.size()) slices *= 2;
+    vector<size_t> bounds(slices + 1);
+    for (size_t i = 0; i <= slices; i++) bounds[i] = v.size() * i / slices;
+    pool.run(slices, [&](size_t i) { stable_sort(v.begin() + bounds[i], v.begin() + bounds[i + 1]); });
+
+    vector<Employee> buffer(v.size());
+    vector<Employee>* from = &v;
+    vector<Employee>* to = &buffer;
+    for (size_t width = 1; width < slices; width *= 2) {
+        size_t pairs = slices / (2 * width);
+        size_t pieces = max<size_t>(1, 4 * pool.size() / pairs);
+        pool.run(pairs * pieces, [&](size_t task) {
+            size_t pair = task / pieces, piece = task % pieces;
+            size_t lo = bounds[2 * width * pair], mid = bounds[2 * width * pair + width], hi = bounds[2 * width * (pair + 1)];
+            auto a = from->begin();
+            // Piece boundaries in the left run, and where the right run splits to match.
+            // Right-run ties go after left-run ones, as stable_sort would order them.
+            size_t a0 = lo + (mid - lo) * piece / pieces;
+            size_t a1 = lo + (mid - lo) * (piece + 1) / pieces;
+            size_t b0 = piece == 0 ? mid : size_t(std::lower_bound(a + mid, a + hi, a[a0]) - a);
+            size_t b1 = piece + 1 == pieces ? hi : size_t(std::lower_bound(a + mid, a + hi, a[a1]) - a);
+            merge(a + a0, a + a1, a + b0, a + b1, to->begin() + a0 + (b0 - mid));
+        });
+        swap(from, to);
+    }
+    if (from != &v) v.swap(buffer);
+}
+
+/* A secondary index on one name field of the employees in a tree, so
+finding everyone named Smith does not mean scanning the whole roster. It
+stores no employees, only the salary each one is filed under, which is
+the tree's own key: a lookup collects the salaries here and then reads the
+matching employees out of those buckets. Names are already interned, so
+exact matches go through a hash on the InternedString id; prefix queries
+walk the distinct names, kept sorted by their characters. The tree that
+owns the index keeps it up to date on every insert and remove.
+
+A common name or title is filed under thousands of salaries, too many to
+search on every remove. A remove only notes the salary, and once a name
+has half as many noted as filed, both lists are sorted and the noted ones
+taken out in one pass: O(log n) per remove, amortized. Until then a
+lookup may visit a salary nobody with the name earns any more, which
+reading the bucket weeds out. */
+class NameIndex {
+public:
+    enum field { firstName, lastName, jobTitle };
+
+    static InternedString key(const Employee& e, field f) {
+        switch (f) {
+        case firstName: return e.firstName;
+        case lastName: return e.lastName;
+        default: return e.jobTitle;
+        }
+    }
+
+    NameIndex(field indexed) : indexed(indexed) {}
+
+    field which() const { return indexed; }
+
+    void add(const Employee& e) {
+        InternedString name = key(e, indexed);
+        posting& entry = postings[name.id()];
+        if (entry.filed.empty()) names.emplace(name.view(), name.id());
+        entry.filed.push_back(e.salary);
+    }
+
+    void remove(const Employee& e) {
+        InternedString name = key(e, indexed);
+        auto found = postings.find(name.id());
+        if (found == postings.end()) return;
+        posting& entry = found->second;
+        entry.dropped.push_back(e.salary);
+        if (entry.dropped.size() * 2 < entry.filed.size()) return;
+        sort(entry.filed.begin(), entry.filed.end());
+        sort(entry.dropped.begin(), entry.dropped.end());
+        vector<int> kept;
+        set_difference(entry.filed.begin(), entry.filed.end(), entry.dropped.begin(), entry.dropped.end(), back_inserter(kept));
+        entry.filed.swap(kept);
+        entry.dropped.clear();
+        if (!entry.filed.empty()) return;
+        names.erase(name.view());
+        postings.erase(found);
+    }
+
+    void clear() {
+        postings.clear();
+        names.clear();
+    }
+
+    // Ids of the stored names that start with prefix, in order
+    vector<uint32_t> withPrefix(string_view prefix) const {
+        vector<uint32_t> out;
+        for (auto it = names.lower_bound(prefix); it != names.end() && it->first.substr(0, prefix.size()) == prefix; ++it) {
+            out.push_back(it->second);
+        }
+        return out;
+    }
+
+    // Every salary an employee with one of these name ids is filed under,
+    // ascending, once each, and perhaps a few they were filed under before
+    vector<int> salaries(const vector<uint32_t>& ids) const {
+        vector<int> out;
+        for (uint32_t id : ids) {
+            auto found = postings.find(id);
+            if (found != postings.end()) out.insert(out.end(), found->second.filed.begin(), found->second.filed.end());
+        }
+        sort(out.begin(), out.end());
+        out.erase(unique(out.begin(), out.end()), out.end());
+        return out;
+    }
+
+private:
+    // The salaries filed under one name, one per employee added, and those
+    // of the employees removed since the list was last compacted
+    struct posting {
+        vector<int> filed;
+        vector<int> dropped;
+    };
+
+    field indexed;
+    unordered_map<uint32_t, posting> postings;      // by name id
+    map<string_view, uint32_t> names;               // every name in postings, by its characters
+};
 
 class EmployeeRBT {
+public:
+    /* How employees who earn the same salary are ordered in their bucket.
+    keyOrder keeps every bucket sorted by EmployeeKeyLess, so findAll lists
+    ties the same way whatever order they arrived in, and remove finds one
+    employee by binary search instead of comparing it against every tie. */
+    enum tieOrder { insertionOrder, keyOrder };
+
+private:
     enum color {red, black};
+    /* Salaries repeat a lot, so each node is one distinct salary holding
+    the bucket of every employee who earns it, in insertion order. Every
+    node also counts the employees in its subtree, bucket included, and
+    totals their salaries, which is what lets rank, select, countInRange
+    and summarize skip whole subtrees. */
     struct node {
-        node(Employee data) : 
-            data(data),
+        node(int salary) :
+            salary(salary),
             left(nullptr),
             right(nullptr),
             parent(nullptr),
-            color(red) {}
+            color(red),
+            subtreeSize(0),
+            subtreeSalary(0) {}
 
-        Employee data;
+        int salary;
+        vector<Employee> employees;
         node* left;
         node* right;
         node* parent;
-        color color;
+        enum color color;
+        size_t subtreeSize;
+        long long subtreeSalary;
 
         bool operator==(const node& other) const {
-            return data == other.data
+            return salary == other.salary
+                && employees == other.employees
                 && left == other.left
                 && right == other.right
                 && parent == other.parent
-                && color == other.color;
+                && color == other.color
+                && subtreeSize == other.subtreeSize
+                && subtreeSalary == other.subtreeSalary;
         }
     };
 
     node* root;
     node* NIL;
+    unique_ptr<NodeAllocator> allocator;
+    tieOrder ties = insertionOrder;
+
+    // Moves [first, last) into the end of bucket, then into place under keyOrder
+    void addToBucket(vector<Employee>& bucket, Employee* first, Employee* last) {
+        size_t old = bucket.size();
+        bucket.insert(bucket.end(), make_move_iterator(first), make_move_iterator(last));
+        if (ties == insertionOrder) return;
+        auto end = bucket.begin() + old;
+        if (bucket.size() == old + 1) {
+            rotate(std::upper_bound(bucket.begin(), end, bucket.back(), EmployeeKeyLess()), end, bucket.end());
+        }
+        else {
+            sort(end, bucket.end(), EmployeeKeyLess());
+            inplace_merge(bucket.begin(), end, bucket.end(), EmployeeKeyLess());
+        }
+    }
+
+    // Where e itself is in bucket, or bucket.end() if it is not there
+    vector<Employee>::iterator findInBucket(vector<Employee>& bucket, const Employee& e) {
+        if (ties == insertionOrder) return std::find(bucket.begin(), bucket.end(), e);
+        auto it = std::lower_bound(bucket.begin(), bucket.end(), e, EmployeeKeyLess());
+        return it != bucket.end() && *it == e ? it : bucket.end();
+    }
+
+    // Takes one copy of each of [first, last) out of bucket, keeping the
+    // rest in order, and returns how many it found.
+    size_t takeFromBucket(vector<Employee>& bucket, const Employee* first, const Employee* last) {
+        if (last - first == 1) {
+            auto it = findInBucket(bucket, *first);
+            if (it == bucket.end()) return 0;
+            removeFromIndexes(*it);
+            bucket.erase(it);
+            return 1;
+        }
+        vector<Employee> targets(first, last);
+        sort(targets.begin(), targets.end(), EmployeeKeyLess());
+        vector<size_t> taken(targets.size(), 0);    // for each run of equal targets, at its first index
+        size_t before = bucket.size();
+        bucket.erase(remove_if(bucket.begin(), bucket.end(), [&](const Employee& e) {
+            auto match = std::equal_range(targets.begin(), targets.end(), e, EmployeeKeyLess());
+            size_t at = size_t(match.first - targets.begin());
+            if (match.first == match.second || taken[at] == size_t(match.second - match.first)) return false;
+            taken[at]++;
+            removeFromIndexes(e);
+            return true;
+        }), bucket.end());
+        return before - bucket.size();
+    }
+
+    // Sorts each run of one salary in sorted, starting at runs[i], by EmployeeKeyLess
+    static void sortRuns(vector<Employee>& sorted, const vector<size_t>& runs) {
+        size_t distinct = runs.size() - 1;
+        WorkerPool& pool = WorkerPool::shared();
+        size_t slices = sorted.size() < (1 << 16) ? 1 : 4 * pool.size();
+        pool.run(slices, [&](size_t slice) {
+            for (size_t i = distinct * slice / slices; i < distinct * (slice + 1) / slices; i++) {
+                sort(sorted.begin() + runs[i], sorted.begin() + runs[i + 1], EmployeeKeyLess());
+            }
+        });
+    }
+
+    unique_ptr<NameIndex> nameIndexes[3];   // by NameIndex::field, only for the fields indexed
+
+    void addToIndexes(const Employee& e) {
+        for (unique_ptr<NameIndex>& index : nameIndexes) {
+            if (index) index->add(e);
+        }
+    }
+
+    void removeFromIndexes(const Employee& e) {
+        for (unique_ptr<NameIndex>& index : nameIndexes) {
+            if (index) index->remove(e);
+        }
+    }
+
+    // The employees whose indexed field has one of ids, read out of the
+    // buckets of the salaries index lists for them, in salary order.
+    vector<Employee> lookup(const NameIndex& index, vector<uint32_t> ids) {
+        vector<Employee> out;
+        sort(ids.begin(), ids.end());
+        for (int salary : index.salaries(ids)) {
+            for (const Employee& e : findAll(salary)) {
+                if (binary_search(ids.begin(), ids.end(), NameIndex::key(e, index.which()).id())) out.push_back(e);
+            }
+        }
+        return out;
+    }
+
+    node* createNode(int salary) {
+        return new (allocator->allocate(sizeof(node))) node(salary);
+    }
+
+    void destroyNode(node* t) {
+        t->~node();
+        allocator->deallocate(t, sizeof(node));
+    }
+
+    // Destroys every node under t. Blocks are only handed back one by one
+    // when giveBack is set; otherwise the caller releases the whole pool.
+    void makeEmpty(node* t, bool giveBack) {
+        if (t == NIL) return;
+        makeEmpty(t->left, giveBack);
+        makeEmpty(t->right, giveBack);
+        t->~node();
+        if (giveBack) allocator->deallocate(t, sizeof(node));
+    }
+
+    // Recounts t's subtree from its children, which must be up to date
+    void updateTotals(node* t) {
+        t->subtreeSize = t->left->subtreeSize + t->right->subtreeSize + t->employees.size();
+        t->subtreeSalary = t->left->subtreeSalary + t->right->subtreeSalary + (long long)t->salary * t->employees.size();
+    }
+
+    // Count and salary total of the employees earning less than salary
+    SalaryStats totalsBelow(int salary) const {
+        SalaryStats below;
+        node* t = root;
+        while (t != NIL) {
+            if (salary <= t->salary) {
+                t = t->left;
+            }
+            else {
+                below.count += t->left->subtreeSize + t->employees.size();
+                below.total += t->left->subtreeSalary + (long long)t->salary * t->employees.size();
+                t = t->right;
+            }
+        }
+        return below;
+    }
 
     // Function to perform Left Rotation
     void leftRotate(node* x) {
@@ -138,6 +863,9 @@ class EmployeeRBT {
         }
         y->left = x;
         x->parent = y;
+        y->subtreeSize = x->subtreeSize;    // y now roots what x rooted
+        y->subtreeSalary = x->subtreeSalary;
+        updateTotals(x);
     }
 
     // Function to perform Left Rotation
@@ -159,6 +887,9 @@ class EmployeeRBT {
         }
         y->right = x;
         x->parent = y;
+        y->subtreeSize = x->subtreeSize;
+        y->subtreeSalary = x->subtreeSalary;
+        updateTotals(x);
     }
 
     void insertFixup(node* n) {
@@ -169,7 +900,7 @@ class EmployeeRBT {
                 if (u->color == red) {                          // case 1: uncle is red
                     u->color = black;                               // color p and u black
                     n->parent->color = black;
-                    n->parent->parent->color = black;               // color grandparent red
+                    n->parent->parent->color = red;                 // color grandparent red
                     n = n->parent->parent;                          // bubble red violation to grandparent
                 }
                 else {                                      // cases 2 and 3: uncle is black
@@ -271,78 +1002,42 @@ class EmployeeRBT {
         x->color = black;
     }
 
-    void transplant(node* u, node* v) {
-        if (u->parent == nullptr) {
-            root = v;
-        }
-        else if (u == u->parent->left) {
-            u->parent->left = v;
-        }
-        else {
-            u->parent->right = v;
-        }
-        v->parent = u->parent;
-    }
-
-    node* find(node* t, int x) {
-        if (t == NIL) return nullptr;
-        else if (x < t->data.salary) return find(t->left, x);
-        else if (x > t->data.salary) return find(t->right, x);
-        else return t;
-    }
-
-    node* minimum(node* t) {
-        if (t == nullptr) return nullptr;
-        else if (t->left == nullptr) return t;
-        else return minimum(t->left);
-    }
-
-    void inorder(node* t) {
-        if (t == NIL)
-            return;
-        inorder(t->left);
-        cout << t->data << endl;
-        inorder(t->right);
-    }
-
-    void inorderConditional(node* t, function<bool(node*)> condition) {
-        if (t == NIL) return;
-        inorderConditional(t->left, condition);
-        if (condition(t)) cout << t->data << endl;
-        inorderConditional(t->right, condition);
-    }
-
-public:
-    EmployeeRBT() {
-        Employee nullEmployee;
-        NIL = new node(nullEmployee);
-        NIL->color = black;
-        NIL->left = NIL->right = NIL;
-        root = NIL;
-    }
-
-    void insert(Employee e) {
-        node* n = new node(e);  // create a new node
-        n->left = n->right = NIL;
-
+    // Adds [first, last), who all earn the same salary, with one descent,
+    // moving them out of the range.
+    void insertRun(Employee* first, Employee* last) {
+        for (Employee* e = first; e != last; ++e) addToIndexes(*e);
+        int salary = first->salary;
+        size_t count = size_t(last - first);
         node* y = nullptr;  // parent of current node
         node* x = root;     // current node
 
         while (x != NIL) {  // traverse down the tree
             y = x;
-            if (n->data < x->data) {
+            x->subtreeSize += count;    // the run lands somewhere below x
+            x->subtreeSalary += (long long)salary * count;
+            if (salary < x->salary) {
                 x = x->left;
             }
-            else {
+            else if (salary > x->salary) {
                 x = x->right;
             }
+            else {          // salary already has a bucket, no new node needed
+                addToBucket(x->employees, first, last);
+                return;
+            }
         }
 
+        node* n = createNode(salary);   // create a new node
+        addToBucket(n->employees, first, last);
+        n->subtreeSize = count;
+        n->subtreeSalary = (long long)salary * count;
+        n->left = n->right = NIL;
+
         n->parent = y;      // set n's parent to y
         if (y == nullptr) { // if it's null, set root to n
             root = n;
         }
-        else if (n->data < y->data) {
+        else if (n->salary < y->salary) {
             y->left = n;    // if n < y, make n its left child
         }
         else {
@@ -361,25 +1056,24 @@ public:
         insertFixup(n);
     }
 
-    void remove(Employee data) {
-        node* z = NIL;
+    // Removes one copy of each of [first, last), who all earn the same
+    // salary, with one descent, and returns how many were stored.
+    size_t removeRun(const Employee* first, const Employee* last) {
         node* x, * y;
 
-        // search for node to delete
-        node* n = root;
-        while (n != NIL) {
-            if (n->data == data) {
-                z = n;
-                break;
-            }
-            else if (n->data < data) {
-                n = n->right;
-            }
-            else {
-                n = n->left;
+        // search for the bucket holding this salary
+        node* z = find(root, first->salary);
+        if (z == nullptr) return 0; // couldn't find node
+
+        size_t removed = takeFromBucket(z->employees, first, last);
+        if (removed == 0) return 0;
+        if (!z->employees.empty()) {    // other employees still earn this salary
+            for (node* t = z; t != nullptr; t = t->parent) {
+                t->subtreeSize -= removed;
+                t->subtreeSalary -= (long long)z->salary * removed;
             }
+            return removed;
         }
-        if (z == NIL) return;   // couldn't find node
 
         y = z;
         color original_color = y->color;    // save original color
@@ -409,40 +1103,2543 @@ public:
             y->left->parent = y;
             y->color = z->color;    // set y's color to z's color
         }
-        delete z;
+        for (node* t = x->parent; t != nullptr; t = t->parent) updateTotals(t);    // everything above where z's subtree changed
+        destroyNode(z);
         if (original_color == black) {
             removeFixup(x);         // if original color is black, fixup
         }
+        return removed;
     }
 
-    Employee* find(int x) {
-        node* result = find(root, x);
-        if (result == nullptr) return nullptr;
-        return &result->data;
-    }
-
-    vector<Employee> findAll(int x) {
-        vector<Employee> out;
-        node* y = find(root, x);
-        if (y == nullptr) return out;
-        out.push_back(y->data);
-        while (true) {
-            y = minimum(y->right);
-            if (y == nullptr || y->data.salary != x) break;
-            out.push_back(y->data);
+    void transplant(node* u, node* v) {
+        if (u->parent == nullptr) {
+            root = v;
         }
-        return out;
+        else if (u == u->parent->left) {
+            u->parent->left = v;
+        }
+        else {
+            u->parent->right = v;
+        }
+        v->parent = u->parent;
     }
 
-    void display() {
-        inorder(root);
+    node* find(node* t, int x) {
+        if (t == NIL) return nullptr;
+        else if (x < t->salary) return find(t->left, x);
+        else if (x > t->salary) return find(t->right, x);
+        else return t;
     }
 
-    void printInRange(int min, int max) {
-        inorderConditional(root, [min, max](node* t) {
-            return t->data.salary >= min && t->data.salary <= max;
-            });
-    }
+    // A subtree that bulkLoad leaves for a worker thread to build
+    struct subtree {
+        size_t lo, hi;
+        int depth;
+        node* parent;
+    };
+
+    /* Builds a balanced subtree under parent out of the salary runs
+    [lo, hi). Run i is sorted[runs[i]] up to sorted[runs[i + 1]], the
+    runs before it earn payroll[i] between them, and its node goes in
+    blocks[i]. Every level above the last one is full, so
+    coloring only the nodes on level redDepth red gives every path the same
+    number of black nodes. With deferred set, subtrees at splitDepth are
+    only queued there: their roots are known in advance (blocks[mid]), so
+    they can be linked now and built later, in parallel. */
+    node* buildBalanced(vector<Employee>& sorted, const vector<size_t>& runs, const vector<long long>& payroll, node* const* blocks,
+                        size_t lo, size_t hi, int depth, int redDepth, node* parent,
+                        vector<subtree>* deferred = nullptr, int splitDepth = 0) {
+        if (lo == hi) return NIL;
+        size_t mid = lo + (hi - lo) / 2;
+        if (deferred != nullptr && depth == splitDepth) {
+            deferred->push_back({ lo, hi, depth, parent });
+            return blocks[mid];
+        }
+        node* t = new (blocks[mid]) node(sorted[runs[mid]].salary);
+        t->employees.assign(
+            make_move_iterator(sorted.begin() + runs[mid]),
+            make_move_iterator(sorted.begin() + runs[mid + 1]));
+        t->color = (depth == redDepth) ? red : black;
+        t->subtreeSize = runs[hi] - runs[lo];
+        t->subtreeSalary = payroll[hi] - payroll[lo];
+        t->parent = parent;
+        t->left = buildBalanced(sorted, runs, payroll, blocks, lo, mid, depth + 1, redDepth, t, deferred, splitDepth);
+        t->right = buildBalanced(sorted, runs, payroll, blocks, mid + 1, hi, depth + 1, redDepth, t, deferred, splitDepth);
+        return t;
+    }
+
+    node* minimum(node* t) const {
+        if (t == NIL) return NIL;
+        else if (t->left == NIL) return t;
+        else return minimum(t->left);
+    }
+
+    node* maximum(node* t) const {
+        if (t == NIL) return NIL;
+        else if (t->right == NIL) return t;
+        else return maximum(t->right);
+    }
+
+    // In-order successor of t, or NIL if t is the maximum
+    node* successor(node* t) const {
+        if (t->right != NIL) return minimum(t->right);
+        node* p = t->parent;
+        while (p != nullptr && t == p->right) {
+            t = p;
+            p = p->parent;
+        }
+        return p == nullptr ? NIL : p;
+    }
+
+    // In-order predecessor of t, or NIL if t is the minimum
+    node* predecessor(node* t) const {
+        if (t->left != NIL) return maximum(t->left);
+        node* p = t->parent;
+        while (p != nullptr && t == p->left) {
+            t = p;
+            p = p->parent;
+        }
+        return p == nullptr ? NIL : p;
+    }
+
+    // Returns the first node, in in-order position, for which goLeft holds,
+    // the same way std::lower_bound bisects an array.
+    template<typename Predicate>
+    node* bound(Predicate goLeft) const {
+        node* result = NIL;
+        node* t = root;
+        while (t != NIL) {
+            if (goLeft(t)) {
+                result = t;
+                t = t->left;
+            }
+            else {
+                t = t->right;
+            }
+        }
+        return result;
+    }
+
+    // Salaries of the nodes on the top levels of t that lie in (min, max],
+    // in order. Each level doubles how many there are.
+    void splitPoints(node* t, int min, int max, int levels, vector<int>& out) {
+        if (t == NIL || levels == 0) return;
+        if (min < t->salary) splitPoints(t->left, min, max, levels - 1, out);
+        if (min < t->salary && t->salary <= max) out.push_back(t->salary);
+        if (t->salary < max) splitPoints(t->right, min, max, levels - 1, out);
+    }
+
+    /* Salaries that cut [min, max] into ranges for the threads of the shared
+    WorkerPool, about 16 per thread across the whole tree, or none with one
+    thread. Range i runs from cuts[i - 1] to cuts[i] - 1, with min and max
+    at the ends. */
+    vector<int> cutPoints(int min, int max) {
+        vector<int> cuts;
+        size_t threads = WorkerPool::shared().size();
+        int levels = 0;
+        while ((size_t(1) << levels) < 16 * threads) levels++;
+        if (threads > 1) splitPoints(root, min, max, levels, cuts);
+        return cuts;
+    }
+
+    // Visits, in order, only the subtrees that can hold salaries in [min, max].
+    template<typename Visitor>
+    void inorderInRange(node* t, int min, int max, Visitor& visit) {
+        if (t == NIL) return;
+        if (min < t->salary) inorderInRange(t->left, min, max, visit);
+        if (min <= t->salary && t->salary <= max) {
+            for (const Employee& e : t->employees) visit(e);
+        }
+        if (t->salary < max) inorderInRange(t->right, min, max, visit);
+    }
+
+public:
+    /* Bidirectional in-order iterator over every employee. It walks the
+    parent pointers between nodes and steps through each node's bucket;
+    NIL is end(). Employees are read-only through the iterator, since
+    changing a salary in place would break the order. */
+    class const_iterator {
+        friend class EmployeeRBT;
+
+        const EmployeeRBT* tree = nullptr;
+        node* n = nullptr;
+        size_t index = 0;
+
+        const_iterator(const EmployeeRBT* tree, node* n) : tree(tree), n(n) {}
+
+    public:
+        using iterator_category = bidirectional_iterator_tag;
+        using value_type = Employee;
+        using difference_type = ptrdiff_t;
+        using pointer = const Employee*;
+        using reference = const Employee&;
+
+        const_iterator() {}
+
+        reference operator*() const { return n->employees[index]; }
+        pointer operator->() const { return &n->employees[index]; }
+
+        const_iterator& operator++() {
+            if (++index < n->employees.size()) return *this;
+            n = tree->successor(n);
+            index = 0;
+            return *this;
+        }
+
+        const_iterator& operator--() {
+            if (n != tree->NIL && index > 0) {
+                --index;
+                return *this;
+            }
+            n = (n == tree->NIL) ? tree->maximum(tree->root) : tree->predecessor(n);
+            index = n->employees.size() - 1;
+            return *this;
+        }
+
+        const_iterator operator++(int) { const_iterator old = *this; ++*this; return old; }
+        const_iterator operator--(int) { const_iterator old = *this; --*this; return old; }
+
+        bool operator==(const const_iterator& other) const { return n == other.n && index == other.index; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+    };
+    using iterator = const_iterator;
+
+    EmployeeRBT(unique_ptr<NodeAllocator> nodeAllocator = make_unique<PoolAllocator>()) :
+        allocator(std::move(nodeAllocator)) {
+        NIL = new node(0);
+        NIL->color = black;
+        NIL->left = NIL->right = NIL;
+        root = NIL;
+    }
+
+    ~EmployeeRBT() {
+        bool bulk = allocator->canRelease();
+        makeEmpty(root, !bulk);
+        if (bulk) allocator->release();
+        delete NIL;
+    }
+
+    const AllocatorStats& allocatorStats() const {
+        return allocator->stats();
+    }
+
+    void insert(const Employee& e) {
+        insert(Employee(e));
+    }
+
+    void insert(Employee&& e) {
+        insertRun(&e, &e + 1);
+    }
+
+    // Builds the employee from args and moves it straight into its bucket.
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        insert(Employee(std::forward<Args>(args)...));
+    }
+
+    void remove(const Employee& data) {
+        removeRun(&data, &data + 1);
+    }
+
+    Employee* find(int x) {
+        node* result = find(root, x);
+        if (result == nullptr) return nullptr;
+        return &result->employees.front();
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, minimum(root));
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, NIL);
+    }
+
+    // First employee whose salary is not less than x.
+    const_iterator lower_bound(int x) const {
+        return const_iterator(this, bound([x](node* t) { return t->salary >= x; }));
+    }
+
+    // First employee whose salary is greater than x.
+    const_iterator upper_bound(int x) const {
+        return const_iterator(this, bound([x](node* t) { return t->salary > x; }));
+    }
+
+    pair<const_iterator, const_iterator> equal_range(int x) const {
+        return { lower_bound(x), upper_bound(x) };
+    }
+
+    // Number of employees in the tree
+    size_t size() const {
+        return root->subtreeSize;
+    }
+
+    // Total of every employee's salary
+    long long payroll() const {
+        return root->subtreeSalary;
+    }
+
+    /* Number of employees earning less than salary, which is also the
+    position of the first employee earning salary or more. O(log n). */
+    size_t rank(int salary) const {
+        return totalsBelow(salary).count;
+    }
+
+    // Number of employees with a salary in [min, max], in O(log n)
+    size_t countInRange(int min, int max) const {
+        if (min > max) return 0;
+        size_t upTo = max == INT_MAX ? size() : rank(max + 1);
+        return upTo - rank(min);
+    }
+
+    /* Head count, total and average payroll, and lowest and highest salary
+    of the employees with a salary in [min, max], in O(log n) without
+    visiting them. */
+    SalaryStats summarize(int min, int max) const {
+        SalaryStats stats;
+        if (min > max) return stats;
+        SalaryStats upTo = max == INT_MAX ? SalaryStats{ size(), payroll() } : totalsBelow(max + 1);
+        SalaryStats below = totalsBelow(min);
+        stats.count = upTo.count - below.count;
+        stats.total = upTo.total - below.total;
+        if (stats.count > 0) {
+            // A salary-ordered tree has the band's extremes at its two ends
+            stats.lowest = lower_bound(min)->salary;
+            stats.highest = prev(upper_bound(max))->salary;
+        }
+        return stats;
+    }
+
+    /* The employee at position k of the in-order sequence, counting from 0,
+    or end() if there are not that many. O(log n). */
+    const_iterator select(size_t k) const {
+        node* t = root;
+        while (t != NIL) {
+            size_t left = t->left->subtreeSize;
+            if (k < left) {
+                t = t->left;
+            }
+            else if (k < left + t->employees.size()) {
+                const_iterator it(this, t);
+                it.index = k - left;
+                return it;
+            }
+            else {
+                k -= left + t->employees.size();
+                t = t->right;
+            }
+        }
+        return end();
+    }
+
+    /* The salary at percentile p, from 0 to 100, by the nearest-rank
+    method: percentile(50) is the median and percentile(100) the highest
+    salary. Throws runtime_error on an empty tree. O(log n). */
+    int percentile(double p) const {
+        if (size() == 0) throw runtime_error("No employees to take a percentile of");
+        if (!(p >= 0 && p <= 100)) throw runtime_error("Percentile must be between 0 and 100");
+        size_t position = size_t(ceil(p / 100 * size()));
+        return select(position == 0 ? 0 : position - 1)->salary;
+    }
+
+    // Every employee earning exactly x, in insertion or key order (see tieOrder)
+    EmployeeSpan findAll(int x) {
+        node* result = find(root, x);
+        if (result == nullptr) return EmployeeSpan();
+        return EmployeeSpan(result->employees.data(), result->employees.size());
+    }
+
+    /* Chooses how ties are ordered from now on. Switching to keyOrder
+    sorts every bucket already in the tree once. */
+    void orderTies(tieOrder order) {
+        if (order == keyOrder && ties != keyOrder) {
+            for (node* n = minimum(root); n != NIL; n = successor(n)) {
+                sort(n->employees.begin(), n->employees.end(), EmployeeKeyLess());
+            }
+        }
+        ties = order;
+    }
+
+    tieOrder tieOrdering() const {
+        return ties;
+    }
+
+    // Whether e itself is stored, not just someone earning its salary
+    bool contains(const Employee& e) {
+        node* t = find(root, e.salary);
+        return t != nullptr && findInBucket(t->employees, e) != t->employees.end();
+    }
+
+    void clear() {
+        makeEmpty(root, true);
+        root = NIL;
+        for (unique_ptr<NameIndex>& index : nameIndexes) {
+            if (index) index->clear();
+        }
+    }
+
+    /* Adds every employee in [first, last) and rebuilds the whole tree
+    perfectly balanced, bottom-up, with no rotations or fixups. Runs in
+    O(n) when the input is already sorted by salary (checked, not assumed)
+    and O(n log n) otherwise. Under insertionOrder, employees sharing a
+    salary keep their relative order, after the ones already in the tree.
+    Large inputs are sorted and built on the shared WorkerPool. */
+    template<typename InputIt>
+    void bulkLoad(InputIt first, InputIt last) {
+        vector<Employee> incoming(first, last);
+        if (!is_sorted(incoming.begin(), incoming.end())) {
+            parallelStableSort(incoming);
+        }
+        for (const Employee& e : incoming) addToIndexes(e);
+        vector<Employee> sorted;
+        if (root == NIL) {
+            sorted = std::move(incoming);
+        }
+        else {
+            vector<Employee> existing(begin(), end());
+            sorted.reserve(existing.size() + incoming.size());
+            merge(existing.begin(), existing.end(), incoming.begin(), incoming.end(), back_inserter(sorted));
+            makeEmpty(root, true);  // not clear(), which would empty the indexes too
+            root = NIL;
+        }
+        vector<size_t> runs;    // where each distinct salary starts
+        for (size_t i = 0; i < sorted.size(); i++) {
+            if (i == 0 || sorted[i].salary != sorted[i - 1].salary) runs.push_back(i);
+        }
+        size_t distinct = runs.size();
+        runs.push_back(sorted.size());
+        if (ties == keyOrder) sortRuns(sorted, runs);
+        vector<long long> payroll(distinct + 1, 0);    // salaries of the runs before each
+        for (size_t i = 0; i < distinct; i++) {
+            payroll[i + 1] = payroll[i] + (long long)sorted[runs[i]].salary * (runs[i + 1] - runs[i]);
+        }
+
+        int lastLevel = 0;      // depth of the deepest level, floor(log2(distinct))
+        while ((size_t(2) << lastLevel) <= distinct) lastLevel++;
+        int redDepth = lastLevel == 0 ? -1 : lastLevel;
+        vector<node*> blocks(distinct);     // one node per salary, in salary order
+        for (node*& b : blocks) b = static_cast<node*>(allocator->allocate(sizeof(node)));
+
+        WorkerPool& pool = WorkerPool::shared();
+        if (pool.size() == 1 || distinct < 4096) {
+            root = buildBalanced(sorted, runs, payroll, blocks.data(), 0, distinct, 0, redDepth, nullptr);
+            return;
+        }
+        // The top levels here, then about four subtrees per thread on the pool
+        int splitDepth = 0;
+        while ((size_t(1) << splitDepth) < 4 * pool.size()) splitDepth++;
+        vector<subtree> deferred;
+        root = buildBalanced(sorted, runs, payroll, blocks.data(), 0, distinct, 0, redDepth, nullptr, &deferred, splitDepth);
+        pool.run(deferred.size(), [&](size_t i) {
+            const subtree& s = deferred[i];
+            buildBalanced(sorted, runs, payroll, blocks.data(), s.lo, s.hi, s.depth, redDepth, s.parent);
+        });
+    }
+
+    template<typename Range>
+    void bulkLoad(const Range& employees) {
+        bulkLoad(std::begin(employees), std::end(employees));
+    }
+
+    /* Keeps a NameIndex on field f from now on, built from the employees
+    already stored. Every insert and remove after that also updates it. */
+    void addIndex(NameIndex::field f) {
+        if (nameIndexes[f]) return;
+        nameIndexes[f] = make_unique<NameIndex>(f);
+        for (const Employee& e : *this) nameIndexes[f]->add(e);
+    }
+
+    void dropIndex(NameIndex::field f) {
+        nameIndexes[f].reset();
+    }
+
+    bool hasIndex(NameIndex::field f) const {
+        return nameIndexes[f] != nullptr;
+    }
+
+    /* Every employee whose field f is exactly name, in salary order.
+    Without an index on f this scans the whole tree. */
+    vector<Employee> findByName(NameIndex::field f, string_view name) {
+        vector<Employee> out;
+        uint32_t id;
+        if (!StringPool::shared().find(name, id)) return out;  // nobody has ever had this name
+        if (nameIndexes[f]) return lookup(*nameIndexes[f], { id });
+        forEachInRange(INT_MIN, INT_MAX, [&](const Employee& e) {
+            if (NameIndex::key(e, f).id() == id) out.push_back(e);
+        });
+        return out;
+    }
+
+    /* Every employee whose field f starts with prefix, in salary order.
+    Without an index on f this scans the whole tree. */
+    vector<Employee> findByPrefix(NameIndex::field f, string_view prefix) {
+        if (nameIndexes[f]) return lookup(*nameIndexes[f], nameIndexes[f]->withPrefix(prefix));
+        vector<Employee> out;
+        forEachInRange(INT_MIN, INT_MAX, [&](const Employee& e) {
+            if (NameIndex::key(e, f).view().substr(0, prefix.size()) == prefix) out.push_back(e);
+        });
+        return out;
+    }
+
+    /* Adds every employee in [first, last). The batch is sorted by salary
+    first, so back-to-back descents share the cache-hot upper levels and
+    everyone on one salary goes in with a single descent. Into an empty
+    tree it is a bulkLoad. */
+    template<typename InputIt>
+    void insertBatch(InputIt first, InputIt last) {
+        if (root == NIL) {
+            bulkLoad(first, last);
+            return;
+        }
+        vector<Employee> batch(first, last);
+        parallelStableSort(batch);
+        for (size_t i = 0, j; i < batch.size(); i = j) {
+            for (j = i + 1; j < batch.size() && batch[j].salary == batch[i].salary; j++) {}
+            insertRun(batch.data() + i, batch.data() + j);
+        }
+    }
+
+    template<typename Range>
+    void insertBatch(const Range& employees) {
+        insertBatch(std::begin(employees), std::end(employees));
+    }
+
+    /* Removes one copy of every employee in [first, last) that is stored,
+    and returns how many were. Sorted like insertBatch, with one descent
+    per salary and one pass over each bucket it touches. */
+    template<typename InputIt>
+    size_t removeBatch(InputIt first, InputIt last) {
+        vector<Employee> batch(first, last);
+        parallelStableSort(batch);
+        size_t removed = 0;
+        for (size_t i = 0, j; i < batch.size(); i = j) {
+            for (j = i + 1; j < batch.size() && batch[j].salary == batch[i].salary; j++) {}
+            removed += removeRun(batch.data() + i, batch.data() + j);
+        }
+        return removed;
+    }
+
+    template<typename Range>
+    size_t removeBatch(const Range& employees) {
+        return removeBatch(std::begin(employees), std::end(employees));
+    }
+
+    /* findAll for every salary in salaries, answered in the same order.
+    The lookups are sorted and resolved in one walk down the tree that
+    splits them at each node, so a node is read once however many lookups
+    pass through it. The spans are valid until the tree next changes. */
+    vector<EmployeeSpan> findBatch(const vector<int>& salaries) {
+        vector<pair<int, size_t>> queries(salaries.size());     // salary, position in salaries
+        for (size_t i = 0; i < salaries.size(); i++) queries[i] = { salaries[i], i };
+        sort(queries.begin(), queries.end());
+        vector<EmployeeSpan> out(salaries.size());
+        struct pending {
+            node* t;
+            size_t lo, hi;      // the queries that reach t
+        };
+        vector<pending> stack;
+        if (!queries.empty()) stack.push_back({ root, 0, queries.size() });
+        while (!stack.empty()) {
+            pending p = stack.back();
+            stack.pop_back();
+            if (p.t == NIL) continue;
+            // [lo, here) go left, [here, right) earn t's salary, [right, hi) go right
+            auto begin = queries.begin();
+            size_t here = std::lower_bound(begin + p.lo, begin + p.hi, make_pair(p.t->salary, size_t(0))) - begin;
+            size_t right = here;
+            while (right < p.hi && queries[right].first == p.t->salary) {
+                out[queries[right++].second] = EmployeeSpan(p.t->employees.data(), p.t->employees.size());
+            }
+            if (p.lo < here) stack.push_back({ p.t->left, p.lo, here });
+            if (right < p.hi) stack.push_back({ p.t->right, right, p.hi });
+        }
+        return out;
+    }
+
+    void display() {
+        printInRange(INT_MIN, INT_MAX);
+    }
+
+    /* Calls visit(const Employee&) on every employee with a salary in
+    [min, max], in salary order. Runs in O(log n + k) for k matches. */
+    template<typename Visitor>
+    void forEachInRange(int min, int max, Visitor visit) {
+        inorderInRange(root, min, max, visit);
+    }
+
+    // Writes every employee with a salary in [min, max] to out, in order.
+    template<typename OutputIt>
+    OutputIt copyInRange(int min, int max, OutputIt out) {
+        forEachInRange(min, max, [&out](const Employee& e) { *out++ = e; });
+        return out;
+    }
+
+    /* Every employee with a salary in [min, max], in order. Wide ranges
+    are cut into parts that are collected in parallel and then joined. */
+    vector<Employee> findInRange(int min, int max) {
+        vector<int> cuts = cutPoints(min, max);
+        vector<Employee> out;
+        if (cuts.empty()) {
+            copyInRange(min, max, back_inserter(out));
+            return out;
+        }
+        vector<vector<Employee>> parts(cuts.size() + 1);
+        WorkerPool::shared().run(parts.size(), [&](size_t i) {
+            copyInRange(i == 0 ? min : cuts[i - 1], i == cuts.size() ? max : cuts[i] - 1, back_inserter(parts[i]));
+        });
+        size_t total = 0;
+        for (const vector<Employee>& part : parts) total += part.size();
+        out.reserve(total);
+        for (const vector<Employee>& part : parts) out.insert(out.end(), part.begin(), part.end());
+        return out;
+    }
+
+    /* Prints every employee with a salary in [min, max], in order. Wide
+    ranges are cut into parts that are formatted in parallel, two per
+    thread at a time, and written out in order. */
+    void printInRange(int min, int max, ostream& os = cout) {
+        vector<int> cuts = cutPoints(min, max);
+        if (cuts.empty()) {
+            forEachInRange(min, max, [&os](const Employee& e) { os << e << '\n'; });
+            os.flush();
+            return;
+        }
+        WorkerPool& pool = WorkerPool::shared();
+        vector<string> text(2 * pool.size());
+        for (size_t first = 0; first <= cuts.size(); first += text.size()) {
+            size_t count = std::min(text.size(), cuts.size() + 1 - first);
+            pool.run(count, [&](size_t i) {
+                size_t part = first + i;
+                ostringstream out;
+                forEachInRange(part == 0 ? min : cuts[part - 1], part == cuts.size() ? max : cuts[part] - 1,
+                    [&out](const Employee& e) { out << e << '\n'; });
+                text[i] = out.str();
+            });
+            for (size_t i = 0; i < count; i++) os.write(text[i].data(), (streamsize)text[i].size());
+        }
+        os.flush();
+    }
+};
+
+/* EmployeeRBT behind a reader-writer lock, so many threads can look up
+salaries while edits trickle in. Lookups take the lock shared and run in
+parallel with each other; insert, remove and bulkLoad take it exclusively.
+Results are copied out, or handed to a visitor while the lock is still
+held, because a span or pointer into the tree would dangle as soon as the
+next writer got in.
+
+Lookups do not use optimistic (seqlock) reads: a reader racing a remove
+could follow a pointer into a node the writer has just freed, and making
+that safe needs deferred reclamation of nodes. */
+class ConcurrentEmployeeRBT {
+    mutable EmployeeRBT tree;       // lookups never change it, but its lookup methods are not const
+    mutable shared_mutex lock;
+    mutable atomic<int> writersWaiting{ 0 };
+
+    // New readers step aside while a writer is queued, so a steady stream of
+    // lookups cannot starve edits (glibc's rwlock prefers readers).
+    shared_lock<shared_mutex> readLock() const {
+        while (writersWaiting.load(memory_order_acquire) > 0) this_thread::yield();
+        return shared_lock<shared_mutex>(lock);
+    }
+
+    unique_lock<shared_mutex> writeLock() {
+        writersWaiting.fetch_add(1, memory_order_acq_rel);
+        unique_lock<shared_mutex> guard(lock);
+        writersWaiting.fetch_sub(1, memory_order_acq_rel);
+        return guard;
+    }
+
+public:
+    ConcurrentEmployeeRBT(unique_ptr<NodeAllocator> allocator = make_unique<PoolAllocator>()) :
+        tree(std::move(allocator)) {}
+
+    ConcurrentEmployeeRBT(const ConcurrentEmployeeRBT&) = delete;
+    ConcurrentEmployeeRBT& operator=(const ConcurrentEmployeeRBT&) = delete;
+
+    void insert(const Employee& e) {
+        unique_lock<shared_mutex> guard = writeLock();
+        tree.insert(e);
+    }
+
+    void insert(Employee&& e) {
+        unique_lock<shared_mutex> guard = writeLock();
+        tree.insert(std::move(e));
+    }
+
+    void remove(const Employee& e) {
+        unique_lock<shared_mutex> guard = writeLock();
+        tree.remove(e);
+    }
+
+    void clear() {
+        unique_lock<shared_mutex> guard = writeLock();
+        tree.clear();
+    }
+
+    template<typename InputIt>
+    void bulkLoad(InputIt first, InputIt last) {
+        unique_lock<shared_mutex> guard = writeLock();
+        tree.bulkLoad(first, last);
+    }
+
+    template<typename Range>
+    void bulkLoad(const Range& employees) {
+        bulkLoad(std::begin(employees), std::end(employees));
+    }
+
+    // Copies the first employee earning salary into out; false if there is none
+    bool find(int salary, Employee& out) const {
+        shared_lock<shared_mutex> guard = readLock();
+        const Employee* found = tree.find(salary);
+        if (found == nullptr) return false;
+        out = *found;
+        return true;
+    }
+
+    // Number of employees earning exactly salary
+    size_t count(int salary) const {
+        shared_lock<shared_mutex> guard = readLock();
+        return tree.findAll(salary).size();
+    }
+
+    vector<Employee> findAll(int salary) const {
+        shared_lock<shared_mutex> guard = readLock();
+        EmployeeSpan found = tree.findAll(salary);
+        return vector<Employee>(found.begin(), found.end());
+    }
+
+    /* Calls visit(const Employee&) on every employee with a salary in
+    [min, max] while holding the lock shared. visit must not write to this
+    tree, or it will deadlock. */
+    template<typename Visitor>
+    void forEachInRange(int min, int max, Visitor visit) const {
+        shared_lock<shared_mutex> guard = readLock();
+        tree.forEachInRange(min, max, visit);
+    }
+
+    template<typename OutputIt>
+    OutputIt copyInRange(int min, int max, OutputIt out) const {
+        shared_lock<shared_mutex> guard = readLock();
+        return tree.copyInRange(min, max, out);
+    }
+
+    vector<Employee> findInRange(int min, int max) const {
+        shared_lock<shared_mutex> guard = readLock();
+        return tree.findInRange(min, max);
+    }
+
+    void printInRange(int min, int max, ostream& os = cout) const {
+        vector<Employee> matches = findInRange(min, max);       // print without holding the lock
+        for (const Employee& e : matches) os << e << '\n';
+        os.flush();
+    }
+};
+
+/* Employees partitioned by salary band across independent EmployeeRBTs,
+each with its own lock and its own PoolAllocator. A point operation locks
+only the shard that holds its salary, so writes to different bands run in
+parallel and every tree stays a fraction of the roster's size. Range
+queries visit only the shards that overlap the range.
+
+Shard i holds salaries from cuts[i - 1] up to cuts[i] - 1; the first and
+last shards are open-ended, so any salary has a home. The cuts start out
+evenly spaced over a band (30000 to 200000 by default) and rebalance()
+moves them to where the roster actually is, so every shard holds about the
+same number of employees.
+
+Point operations route by the cuts before taking a shard lock, and share
+no lock with each other. rebalance() holds every shard lock while it moves
+the cuts and keeps layout odd for the duration, so an operation that
+routed by cuts that have since moved sees layout change under the shard
+lock and routes again. Range queries, which read many cuts, hold
+layoutLock shared; rebalance() and bulkLoad() hold it exclusively, so a
+range query sees every shard from before a reload or every shard after. */
+class ShardedEmployeeRBT {
+    struct alignas(64) shard {
+        EmployeeRBT tree;
+        shared_mutex lock;
+    };
+
+    size_t total;
+    unique_ptr<shard[]> shards;
+    unique_ptr<atomic<int>[]> cuts;     // total - 1 of them, never decreasing
+    atomic<uint64_t> layout{ 0 };       // odd while rebalance() moves the cuts
+    mutable shared_mutex layoutLock;    // held exclusively by rebalance() and bulkLoad(), shared by range queries
+
+    size_t shardOf(int salary) const {
+        size_t lo = 0, hi = total - 1;  // first cut above salary, by bisection
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (cuts[mid].load(memory_order_relaxed) <= salary) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // Lowest and highest salary shard i can hold
+    int lowest(size_t i) const { return i == 0 ? INT_MIN : cuts[i - 1].load(memory_order_relaxed); }
+    int highest(size_t i) const { return i + 1 == total ? INT_MAX : cuts[i].load(memory_order_relaxed) - 1; }
+
+    // Calls op(EmployeeRBT&) on the shard that holds salary with its lock
+    // held, exclusively if Lock is unique_lock, and returns what op does.
+    template<typename Lock, typename Op>
+    auto withShard(int salary, Op op) const {
+        while (true) {
+            uint64_t seen = layout.load();
+            if (seen % 2 == 1) {
+                this_thread::yield();   // a rebalance is moving the cuts
+                continue;
+            }
+            shard& s = shards[shardOf(salary)];
+            Lock guard(s.lock);
+            if (layout.load() == seen) return op(s.tree);
+        }
+    }
+
+    // Locks every shard exclusively, in order, for rebalance() and bulkLoad()
+    vector<unique_lock<shared_mutex>> lockAll() {
+        vector<unique_lock<shared_mutex>> guards;
+        guards.reserve(total);
+        for (size_t i = 0; i < total; i++) guards.emplace_back(shards[i].lock);
+        return guards;
+    }
+
+    // Replaces every shard's tree with its slice of sorted. The caller holds lockAll().
+    void load(const vector<Employee>& sorted) {
+        vector<size_t> starts(total + 1, sorted.size());
+        starts[0] = 0;
+        for (size_t i = 1; i < total; i++) {
+            starts[i] = size_t(std::lower_bound(sorted.begin() + starts[i - 1], sorted.end(), lowest(i),
+                [](const Employee& e, int salary) { return e.salary < salary; }) - sorted.begin());
+        }
+        WorkerPool::shared().run(total, [&](size_t i) {
+            shards[i].tree.clear();
+            shards[i].tree.bulkLoad(sorted.begin() + starts[i], sorted.begin() + starts[i + 1]);
+        });
+    }
+
+public:
+    ShardedEmployeeRBT(size_t shardCount = 16, int low = 30'000, int high = 200'000) :
+        total(max<size_t>(shardCount, 1)),
+        shards(new shard[total]),
+        cuts(new atomic<int>[total - 1]) {
+        for (size_t i = 1; i < total; i++) cuts[i - 1] = low + int((long long)(high - low) * i / total);
+    }
+
+    ShardedEmployeeRBT(const ShardedEmployeeRBT&) = delete;
+    ShardedEmployeeRBT& operator=(const ShardedEmployeeRBT&) = delete;
+
+    size_t shardCount() const { return total; }
+
+    // The salaries the shards start at, after the first
+    vector<int> boundaries() const {
+        vector<int> out;
+        for (size_t i = 0; i + 1 < total; i++) out.push_back(cuts[i].load());
+        return out;
+    }
+
+    void insert(const Employee& e) {
+        withShard<unique_lock<shared_mutex>>(e.salary, [&e](EmployeeRBT& tree) { tree.insert(e); });
+    }
+
+    void remove(const Employee& e) {
+        withShard<unique_lock<shared_mutex>>(e.salary, [&e](EmployeeRBT& tree) { tree.remove(e); });
+    }
+
+    // Copies the first employee earning salary into out; false if there is none
+    bool find(int salary, Employee& out) const {
+        return withShard<shared_lock<shared_mutex>>(salary, [&](EmployeeRBT& tree) {
+            const Employee* found = tree.find(salary);
+            if (found == nullptr) return false;
+            out = *found;
+            return true;
+        });
+    }
+
+    // Number of employees earning exactly salary
+    size_t count(int salary) const {
+        return withShard<shared_lock<shared_mutex>>(salary, [salary](EmployeeRBT& tree) {
+            return tree.findAll(salary).size();
+        });
+    }
+
+    vector<Employee> findAll(int salary) const {
+        return withShard<shared_lock<shared_mutex>>(salary, [salary](EmployeeRBT& tree) {
+            EmployeeSpan found = tree.findAll(salary);
+            return vector<Employee>(found.begin(), found.end());
+        });
+    }
+
+    /* Adds every employee in [first, last), sorting them once and bulk
+    loading each shard's slice on the shared WorkerPool. The cuts stay
+    where they are; call rebalance() to fit them to the roster. */
+    template<typename InputIt>
+    void bulkLoad(InputIt first, InputIt last) {
+        vector<Employee> incoming(first, last);
+        if (!is_sorted(incoming.begin(), incoming.end())) parallelStableSort(incoming);
+        unique_lock<shared_mutex> ranges(layoutLock);
+        vector<unique_lock<shared_mutex>> guards = lockAll();
+        vector<Employee> existing;
+        for (size_t i = 0; i < total; i++) existing.insert(existing.end(), shards[i].tree.begin(), shards[i].tree.end());
+        // Employees already stored go first among equal salaries, as in EmployeeRBT::bulkLoad
+        vector<Employee> sorted;
+        sorted.reserve(existing.size() + incoming.size());
+        merge(existing.begin(), existing.end(), incoming.begin(), incoming.end(), back_inserter(sorted));
+        load(sorted);
+    }
+
+    template<typename Range>
+    void bulkLoad(const Range& employees) {
+        bulkLoad(std::begin(employees), std::end(employees));
+    }
+
+    /* Moves the cuts so every shard holds about the same number of
+    employees, and rebuilds the shards to match. Blocks every other
+    operation while it runs, in O(n). */
+    void rebalance() {
+        unique_lock<shared_mutex> ranges(layoutLock);
+        vector<unique_lock<shared_mutex>> guards = lockAll();
+        vector<Employee> sorted;
+        for (size_t i = 0; i < total; i++) sorted.insert(sorted.end(), shards[i].tree.begin(), shards[i].tree.end());
+        if (sorted.empty()) return;
+        layout++;
+        for (size_t i = 1; i < total; i++) {
+            // A salary is never split; a long run of one salary can leave a shard empty.
+            // Past INT_MAX the cut stays equal to the last, so the cuts never decrease.
+            int cut = sorted[sorted.size() * i / total].salary;
+            if (i > 1 && cut <= cuts[i - 2]) cut = cuts[i - 2] == INT_MAX ? INT_MAX : cuts[i - 2] + 1;
+            cuts[i - 1] = cut;
+        }
+        load(sorted);
+        layout++;
+    }
+
+    /* Calls visit(const Employee&) on every employee with a salary in
+    [min, max], in salary order, one overlapping shard at a time with that
+    shard's lock held shared. visit must not write to this store. */
+    template<typename Visitor>
+    void forEachInRange(int min, int max, Visitor visit) const {
+        shared_lock<shared_mutex> ranges(layoutLock);
+        if (min > max) return;
+        for (size_t i = shardOf(min); i < total && lowest(i) <= max; i++) {
+            shared_lock<shared_mutex> guard(shards[i].lock);
+            shards[i].tree.forEachInRange(std::max(min, lowest(i)), std::min(max, highest(i)), visit);
+        }
+    }
+
+    template<typename OutputIt>
+    OutputIt copyInRange(int min, int max, OutputIt out) const {
+        forEachInRange(min, max, [&out](const Employee& e) { *out++ = e; });
+        return out;
+    }
+
+    // Collects the overlapping shards in parallel on the shared WorkerPool
+    vector<Employee> findInRange(int min, int max) const {
+        shared_lock<shared_mutex> ranges(layoutLock);
+        vector<Employee> out;
+        if (min > max) return out;
+        size_t first = shardOf(min), last = shardOf(max);
+        vector<vector<Employee>> parts(last - first + 1);
+        WorkerPool::shared().run(parts.size(), [&](size_t i) {
+            shard& s = shards[first + i];
+            shared_lock<shared_mutex> guard(s.lock);
+            s.tree.copyInRange(std::max(min, lowest(first + i)), std::min(max, highest(first + i)), back_inserter(parts[i]));
+        });
+        for (const vector<Employee>& part : parts) out.insert(out.end(), part.begin(), part.end());
+        return out;
+    }
+
+    void printInRange(int min, int max, ostream& os = cout) const {
+        vector<Employee> matches = findInRange(min, max);       // print without holding any lock
+        for (const Employee& e : matches) os << e << '\n';
+        os.flush();
+    }
+};
+
+/* A persistent red-black tree: insert and remove never change a node that
+readers can see. They copy the path from the root to the change, rebalance
+the copies, and publish the new root with one atomic store. A reader takes
+a version (current()), which is an immutable point-in-time view it can
+search and scan for as long as it likes, with no locks and without ever
+holding up a writer.
+
+Writers are serialized by a mutex. Deletion follows Kahrs' functional
+red-black delete; insertion is Okasaki's balance. Every node a write
+replaces is retired, not freed, and tagged with the epoch its new root was
+published in. A version pins the epoch it was taken in, in one of a fixed
+set of reader slots, and retired nodes are freed once every pinned epoch
+is newer than theirs (epoch-based reclamation).
+
+Buckets are shared between a node and its copies, so a path copy costs
+O(log n) small nodes, and a bucket is only copied when it changes. */
+class PersistentEmployeeRBT {
+    enum color { red, black };
+
+    struct node {
+        node(enum color color, const node* left, int salary, const vector<Employee>* employees, const node* right) :
+            color(color), left(left), right(right), salary(salary), employees(employees) {}
+
+        const enum color color;
+        const node* const left;
+        const node* const right;
+        const int salary;
+        const vector<Employee>* const employees;
+    };
+
+    // The contents of a node apart from its color and children
+    struct entry {
+        int salary;
+        const vector<Employee>* employees;
+    };
+
+    // Nodes and buckets dropped by one write, freed once no version can see them
+    struct retired {
+        uint64_t epoch = 0;
+        vector<const node*> nodes;
+        vector<const vector<Employee>*> buckets;
+    };
+
+    // One pinned epoch, or 0. Each slot has a cache line to itself so
+    // readers in different slots do not slow each other down.
+    struct alignas(64) readerSlot {
+        atomic<uint64_t> epoch{ 0 };
+    };
+
+    static constexpr size_t readerSlots = 128;  // versions that can be held at once
+    static constexpr size_t reclaimBatch = 32;  // writes between scans of the reader slots
+
+    atomic<const node*> root{ nullptr };
+    atomic<uint64_t> epoch{ 1 };
+    mutable readerSlot slots[readerSlots];
+
+    mutex writeLock;            // guards everything below
+    retired dropped;            // what the write in progress has replaced
+    deque<retired> limbo;       // oldest first
+
+    static bool isRed(const node* t) { return t != nullptr && t->color == red; }
+    static bool isBlack(const node* t) { return t != nullptr && t->color == black; }
+    static entry key(const node* t) { return { t->salary, t->employees }; }
+
+    const node* make(enum color c, const node* left, entry x, const node* right) {
+        return new node(c, left, x.salary, x.employees, right);
+    }
+
+    void retire(const node* t) { dropped.nodes.push_back(t); }
+
+    static const node* find(const node* t, int salary) {
+        while (t != nullptr && t->salary != salary) t = salary < t->salary ? t->left : t->right;
+        return t;
+    }
+
+    // Rebuilds any red-red violation under a black grandparent
+    const node* balance(const node* a, entry x, const node* b) {
+        if (isRed(a) && isRed(b)) {
+            retire(a);
+            retire(b);
+            return make(red, make(black, a->left, key(a), a->right), x, make(black, b->left, key(b), b->right));
+        }
+        if (isRed(a) && isRed(a->left)) {
+            const node* ll = a->left;
+            retire(a);
+            retire(ll);
+            return make(red, make(black, ll->left, key(ll), ll->right), key(a), make(black, a->right, x, b));
+        }
+        if (isRed(a) && isRed(a->right)) {
+            const node* lr = a->right;
+            retire(a);
+            retire(lr);
+            return make(red, make(black, a->left, key(a), lr->left), key(lr), make(black, lr->right, x, b));
+        }
+        if (isRed(b) && isRed(b->right)) {
+            const node* rr = b->right;
+            retire(b);
+            retire(rr);
+            return make(red, make(black, a, x, b->left), key(b), make(black, rr->left, key(rr), rr->right));
+        }
+        if (isRed(b) && isRed(b->left)) {
+            const node* rl = b->left;
+            retire(b);
+            retire(rl);
+            return make(red, make(black, a, x, rl->left), key(rl), make(black, rl->right, key(b), b->right));
+        }
+        return make(black, a, x, b);
+    }
+
+    // Inserts a new salary, whose bucket is x.employees
+    const node* insert(const node* t, entry x) {
+        if (t == nullptr) return make(red, nullptr, x, nullptr);
+        retire(t);
+        if (x.salary < t->salary) {
+            const node* left = insert(t->left, x);
+            return t->color == black ? balance(left, key(t), t->right) : make(red, left, key(t), t->right);
+        }
+        const node* right = insert(t->right, x);
+        return t->color == black ? balance(t->left, key(t), right) : make(red, t->left, key(t), right);
+    }
+
+    // Copies the path to salary, giving its node the bucket employees
+    const node* replaceBucket(const node* t, int salary, const vector<Employee>* employees) {
+        retire(t);
+        if (salary < t->salary) return make(t->color, replaceBucket(t->left, salary, employees), key(t), t->right);
+        if (salary > t->salary) return make(t->color, t->left, key(t), replaceBucket(t->right, salary, employees));
+        dropped.buckets.push_back(t->employees);
+        return make(t->color, t->left, { salary, employees }, t->right);
+    }
+
+    // Turns a black node red; only called where the black heights say it is black
+    const node* redden(const node* t) {
+        if (!isBlack(t)) throw logic_error("PersistentEmployeeRBT: red-black invariant broken");
+        retire(t);
+        return make(red, t->left, key(t), t->right);
+    }
+
+    // Rebalances after the left subtree lost one black level
+    const node* balanceLeft(const node* bl, entry x, const node* c) {
+        if (isRed(bl)) {
+            retire(bl);
+            return make(red, make(black, bl->left, key(bl), bl->right), x, c);
+        }
+        if (isBlack(c)) {
+            retire(c);
+            return balance(bl, x, make(red, c->left, key(c), c->right));
+        }
+        if (isRed(c) && isBlack(c->left)) {
+            const node* cl = c->left;
+            retire(c);
+            retire(cl);
+            return make(red, make(black, bl, x, cl->left), key(cl), balance(cl->right, key(c), redden(c->right)));
+        }
+        throw logic_error("PersistentEmployeeRBT: red-black invariant broken");
+    }
+
+    // Rebalances after the right subtree lost one black level
+    const node* balanceRight(const node* a, entry x, const node* bl) {
+        if (isRed(bl)) {
+            retire(bl);
+            return make(red, a, x, make(black, bl->left, key(bl), bl->right));
+        }
+        if (isBlack(a)) {
+            retire(a);
+            return balance(make(red, a->left, key(a), a->right), x, bl);
+        }
+        if (isRed(a) && isBlack(a->right)) {
+            const node* ar = a->right;
+            retire(a);
+            retire(ar);
+            return make(red, balance(redden(a->left), key(a), ar->left), key(ar), make(black, ar->right, x, bl));
+        }
+        throw logic_error("PersistentEmployeeRBT: red-black invariant broken");
+    }
+
+    // Joins two subtrees of equal black height, every salary in a below b's
+    const node* join(const node* a, const node* b) {
+        if (a == nullptr) return b;
+        if (b == nullptr) return a;
+        if (isRed(a) && isRed(b)) {
+            retire(a);
+            retire(b);
+            const node* middle = join(a->right, b->left);
+            if (isRed(middle)) {
+                retire(middle);
+                return make(red, make(red, a->left, key(a), middle->left), key(middle),
+                    make(red, middle->right, key(b), b->right));
+            }
+            return make(red, a->left, key(a), make(red, middle, key(b), b->right));
+        }
+        if (isBlack(a) && isBlack(b)) {
+            retire(a);
+            retire(b);
+            const node* middle = join(a->right, b->left);
+            if (isRed(middle)) {
+                retire(middle);
+                return make(red, make(black, a->left, key(a), middle->left), key(middle),
+                    make(black, middle->right, key(b), b->right));
+            }
+            return balanceLeft(a->left, key(a), make(black, middle, key(b), b->right));
+        }
+        if (isRed(b)) {
+            retire(b);
+            return make(red, join(a, b->left), key(b), b->right);
+        }
+        retire(a);
+        return make(red, a->left, key(a), join(a->right, b));
+    }
+
+    // Removes the node for salary, which must be in t
+    const node* erase(const node* t, int salary) {
+        retire(t);
+        if (salary < t->salary) {
+            if (isBlack(t->left)) return balanceLeft(erase(t->left, salary), key(t), t->right);
+            return make(red, erase(t->left, salary), key(t), t->right);
+        }
+        if (salary > t->salary) {
+            if (isBlack(t->right)) return balanceRight(t->left, key(t), erase(t->right, salary));
+            return make(red, t->left, key(t), erase(t->right, salary));
+        }
+        dropped.buckets.push_back(t->employees);
+        return join(t->left, t->right);
+    }
+
+    const node* blacken(const node* t) {
+        if (!isRed(t)) return t;
+        retire(t);
+        return make(black, t->left, key(t), t->right);
+    }
+
+    // Makes newRoot current and frees whatever no version can still see.
+    // The caller holds writeLock.
+    void publish(const node* newRoot) {
+        root.store(newRoot);
+        dropped.epoch = epoch.fetch_add(1) + 1;
+        limbo.push_back(std::move(dropped));
+        dropped = retired();
+        if (limbo.size() < reclaimBatch) return;
+
+        uint64_t oldest = UINT64_MAX;
+        for (const readerSlot& s : slots) {
+            uint64_t pinned = s.epoch.load();
+            if (pinned != 0) oldest = min(oldest, pinned);
+        }
+        while (!limbo.empty() && limbo.front().epoch <= oldest) {
+            for (const node* t : limbo.front().nodes) delete t;
+            for (const vector<Employee>* b : limbo.front().buckets) delete b;
+            limbo.pop_front();
+        }
+    }
+
+    // Retires every node and bucket under t, collecting its employees in order
+    void retireAll(const node* t, vector<Employee>& out) {
+        if (t == nullptr) return;
+        retireAll(t->left, out);
+        out.insert(out.end(), t->employees->begin(), t->employees->end());
+        retire(t);
+        dropped.buckets.push_back(t->employees);
+        retireAll(t->right, out);
+    }
+
+    // Builds salary runs [lo, hi) of sorted; see EmployeeRBT::buildBalanced
+    const node* build(const vector<Employee>& sorted, const vector<size_t>& runs, size_t lo, size_t hi, int depth, int redDepth) {
+        if (lo == hi) return nullptr;
+        size_t mid = lo + (hi - lo) / 2;
+        const node* left = build(sorted, runs, lo, mid, depth + 1, redDepth);
+        const node* right = build(sorted, runs, mid + 1, hi, depth + 1, redDepth);
+        vector<Employee>* bucket = new vector<Employee>(sorted.begin() + runs[mid], sorted.begin() + runs[mid + 1]);
+        return make(depth == redDepth ? red : black, left, { sorted[runs[mid]].salary, bucket }, right);
+    }
+
+    static void destroy(const node* t) {
+        if (t == nullptr) return;
+        destroy(t->left);
+        destroy(t->right);
+        delete t->employees;
+        delete t;
+    }
+
+public:
+    /* An immutable view of the tree as it was when current() returned.
+    Holding one keeps the nodes it can see alive, so release long-lived
+    versions when the report is done. Not copyable, only movable. */
+    class version {
+        friend class PersistentEmployeeRBT;
+
+        readerSlot* slot = nullptr;
+        const node* root = nullptr;
+
+        version(readerSlot* slot, const node* root) : slot(slot), root(root) {}
+
+        template<typename Visitor>
+        static void inorderInRange(const node* t, int min, int max, Visitor& visit) {
+            if (t == nullptr) return;
+            if (min < t->salary) inorderInRange(t->left, min, max, visit);
+            if (min <= t->salary && t->salary <= max) {
+                for (const Employee& e : *t->employees) visit(e);
+            }
+            if (t->salary < max) inorderInRange(t->right, min, max, visit);
+        }
+
+    public:
+        version() {}
+        version(const version&) = delete;
+        version& operator=(const version&) = delete;
+
+        version(version&& other) noexcept : slot(other.slot), root(other.root) {
+            other.slot = nullptr;
+        }
+
+        version& operator=(version&& other) noexcept {
+            if (this != &other) {
+                release();
+                slot = other.slot;
+                root = other.root;
+                other.slot = nullptr;
+            }
+            return *this;
+        }
+
+        ~version() {
+            release();
+        }
+
+        void release() {
+            if (slot != nullptr) slot->epoch.store(0, memory_order_release);
+            slot = nullptr;
+            root = nullptr;
+        }
+
+        bool empty() const { return root == nullptr; }
+
+        const Employee* find(int salary) const {
+            const node* t = PersistentEmployeeRBT::find(root, salary);
+            return t == nullptr ? nullptr : &t->employees->front();
+        }
+
+        EmployeeSpan findAll(int salary) const {
+            const node* t = PersistentEmployeeRBT::find(root, salary);
+            if (t == nullptr) return EmployeeSpan();
+            return EmployeeSpan(t->employees->data(), t->employees->size());
+        }
+
+        template<typename Visitor>
+        void forEachInRange(int min, int max, Visitor visit) const {
+            inorderInRange(root, min, max, visit);
+        }
+
+        template<typename OutputIt>
+        OutputIt copyInRange(int min, int max, OutputIt out) const {
+            forEachInRange(min, max, [&out](const Employee& e) { *out++ = e; });
+            return out;
+        }
+
+        vector<Employee> findInRange(int min, int max) const {
+            vector<Employee> out;
+            copyInRange(min, max, back_inserter(out));
+            return out;
+        }
+
+        void printInRange(int min, int max, ostream& os = cout) const {
+            forEachInRange(min, max, [&os](const Employee& e) { os << e << '\n'; });
+            os.flush();
+        }
+    };
+
+    PersistentEmployeeRBT() {}
+    PersistentEmployeeRBT(const PersistentEmployeeRBT&) = delete;
+    PersistentEmployeeRBT& operator=(const PersistentEmployeeRBT&) = delete;
+
+    // Every version must have been released by now
+    ~PersistentEmployeeRBT() {
+        destroy(root.load());
+        for (retired& r : limbo) {
+            for (const node* t : r.nodes) delete t;
+            for (const vector<Employee>* b : r.buckets) delete b;
+        }
+    }
+
+    /* The tree as of now. It claims a free reader slot, pins the current
+    epoch in it, and only then reads the root, so a writer that publishes
+    after the pin cannot free anything this version reaches. It takes no
+    lock and never waits for a writer, but only readerSlots versions can be
+    held at once: while every slot is taken it spins, yielding, until
+    another version is released. */
+    version current() const {
+        size_t start = hash<thread::id>()(this_thread::get_id()) % readerSlots;
+        for (size_t i = start;; i = (i + 1) % readerSlots) {
+            uint64_t expected = 0;
+            if (slots[i].epoch.compare_exchange_strong(expected, epoch.load())) {
+                const node* r = root.load();
+                return version(&slots[i], r);
+            }
+            if ((i + 1) % readerSlots == start) this_thread::yield();   // every slot is taken
+        }
+    }
+
+    void insert(const Employee& e) {
+        lock_guard<mutex> guard(writeLock);
+        const node* r = root.load();
+        const node* existing = find(r, e.salary);
+        vector<Employee>* bucket = new vector<Employee>();
+        if (existing != nullptr) {
+            bucket->reserve(existing->employees->size() + 1);
+            *bucket = *existing->employees;
+            bucket->push_back(e);
+            r = replaceBucket(r, e.salary, bucket);
+        }
+        else {
+            bucket->push_back(e);
+            r = blacken(insert(r, { e.salary, bucket }));
+        }
+        publish(r);
+    }
+
+    void remove(const Employee& e) {
+        lock_guard<mutex> guard(writeLock);
+        const node* r = root.load();
+        const node* existing = find(r, e.salary);
+        if (existing == nullptr) return;
+        const vector<Employee>& old = *existing->employees;
+        auto it = std::find(old.begin(), old.end(), e);
+        if (it == old.end()) return;
+        if (old.size() > 1) {
+            vector<Employee>* bucket = new vector<Employee>();
+            bucket->reserve(old.size() - 1);
+            bucket->insert(bucket->end(), old.begin(), it);
+            bucket->insert(bucket->end(), it + 1, old.end());
+            r = replaceBucket(r, e.salary, bucket);
+        }
+        else {
+            r = blacken(erase(r, e.salary));
+        }
+        publish(r);
+    }
+
+    /* Adds every employee in [first, last) and publishes one perfectly
+    balanced tree holding them and everything already there, built bottom-up
+    the way EmployeeRBT::bulkLoad does. Versions taken before keep seeing
+    the old tree. */
+    template<typename InputIt>
+    void bulkLoad(InputIt first, InputIt last) {
+        vector<Employee> incoming(first, last);
+        if (!is_sorted(incoming.begin(), incoming.end())) stable_sort(incoming.begin(), incoming.end());
+        lock_guard<mutex> guard(writeLock);
+        vector<Employee> existing;
+        retireAll(root.load(), existing);
+        vector<Employee> sorted;
+        sorted.reserve(existing.size() + incoming.size());
+        merge(existing.begin(), existing.end(), incoming.begin(), incoming.end(), back_inserter(sorted));
+
+        vector<size_t> runs;    // where each distinct salary starts
+        for (size_t i = 0; i < sorted.size(); i++) {
+            if (i == 0 || sorted[i].salary != sorted[i - 1].salary) runs.push_back(i);
+        }
+        size_t distinct = runs.size();
+        runs.push_back(sorted.size());
+        int lastLevel = 0;      // depth of the deepest level, floor(log2(distinct))
+        while ((size_t(2) << lastLevel) <= distinct) lastLevel++;
+        publish(build(sorted, runs, 0, distinct, 0, lastLevel == 0 ? -1 : lastLevel));
+    }
+
+    template<typename Range>
+    void bulkLoad(const Range& employees) {
+        bulkLoad(std::begin(employees), std::end(employees));
+    }
+};
+
+/* Counting how many of a node's 16 sorted keys are below a salary is the
+inner loop of every SalaryIndex lookup. The SIMD kernels compare all 16
+keys at once and count the matching lanes instead of taking one branch
+per key. The fastest kernel the CPU supports is picked once,
+at first use, and can be overridden for benchmarking. */
+class KeySearch {
+public:
+    enum kernel { scalar, sse2, avx2 };     // ordered from slowest to fastest
+
+    static int rankScalar(const int* keys, int x) {
+        int r = 0;
+        for (int i = 0; i < 16; i++) r += (keys[i] < x);
+        return r;
+    }
+
+#if EMPLOYEE_X86
+    // keys must be 16-byte aligned
+    static TARGET_SSE2 int rankSse2(const int* keys, int x) {
+        __m128i v = _mm_set1_epi32(x);
+        __m128i a = _mm_cmpgt_epi32(v, _mm_load_si128((const __m128i*)keys));
+        __m128i b = _mm_cmpgt_epi32(v, _mm_load_si128((const __m128i*)(keys + 4)));
+        __m128i c = _mm_cmpgt_epi32(v, _mm_load_si128((const __m128i*)(keys + 8)));
+        __m128i d = _mm_cmpgt_epi32(v, _mm_load_si128((const __m128i*)(keys + 12)));
+        // Each lane is -1 where the key is below x; add them all up.
+        __m128i sum = _mm_add_epi32(_mm_add_epi32(a, b), _mm_add_epi32(c, d));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+        return -_mm_cvtsi128_si32(sum);
+    }
+
+    // keys must be 32-byte aligned
+    static TARGET_AVX2 int rankAvx2(const int* keys, int x) {
+        __m256i v = _mm256_set1_epi32(x);
+        __m256i lo = _mm256_cmpgt_epi32(v, _mm256_load_si256((const __m256i*)keys));
+        __m256i hi = _mm256_cmpgt_epi32(v, _mm256_load_si256((const __m256i*)(keys + 8)));
+        unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(lo))
+            | ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(hi)) << 8);
+        return (int)_mm_popcnt_u32(mask);
+    }
+#endif
+
+    // Number of the 16 keys that are less than x
+    static int rank(const int* keys, int x) {
+        switch (active()) {
+#if EMPLOYEE_X86
+        case avx2: return rankAvx2(keys, x);
+        case sse2: return rankSse2(keys, x);
+#endif
+        default: return rankScalar(keys, x);
+        }
+    }
+
+    // Best kernel this CPU (and OS) can run
+    static kernel detect() {
+#if EMPLOYEE_X86 && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        bool hasSse2 = (info[3] & (1 << 26)) != 0;
+        bool hasPopcnt = (info[2] & (1 << 23)) != 0;
+        bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+        bool hasAvx2 = false;
+        if (maxLeaf >= 7 && hasPopcnt && osSavesYmm) {
+            __cpuidex(info, 7, 0);
+            hasAvx2 = (info[1] & (1 << 5)) != 0;
+        }
+        if (hasAvx2) return avx2;
+        if (hasSse2) return sse2;
+#elif EMPLOYEE_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return avx2;
+        if (__builtin_cpu_supports("sse2")) return sse2;
+#endif
+        return scalar;
+    }
+
+    static kernel active() {
+        return selected();
+    }
+
+    // Forces a kernel; fails if the CPU cannot run it.
+    static bool use(kernel k) {
+        if (k > detect()) return false;
+        selected() = k;
+        return true;
+    }
+
+    static const char* name(kernel k) {
+        switch (k) {
+        case avx2: return "avx2";
+        case sse2: return "sse2";
+        default: return "scalar";
+        }
+    }
+
+private:
+    static kernel& selected() {
+        static kernel k = detect();
+        return k;
+    }
+};
+
+/* A frozen, read-optimized copy of a tree for read-mostly workloads.
+The employees are copied once, in salary order, into one contiguous
+payload array. The distinct salaries are indexed by a static B+ tree
+whose nodes are 16 keys filling exactly one 64-byte cache line, so a
+lookup touches one line per level instead of chasing a pointer per
+level. Every run of equal salaries, and every salary range, is a
+contiguous span of the payload. Changes to the source tree after
+construction are not seen. */
+class SalaryIndex {
+public:
+    static constexpr int B = 16;    // keys per node
+
+private:
+    struct alignas(64) keyBlock {
+        int keys[B];
+    };
+
+    vector<Employee> records;   // payload, sorted by salary
+    vector<size_t> offsets;     // distinct salary i owns records[offsets[i], offsets[i + 1])
+    size_t distinct = 0;
+    vector<keyBlock> blocks;    // every layer, root layer first
+    vector<size_t> layerStart;  // first block of each layer, root layer first
+
+    // Number of keys in the block that are less than x
+    static int rank(const keyBlock& b, int x) {
+        return KeySearch::rank(b.keys, x);
+    }
+
+    // Position of the first distinct salary that is not less than x
+    size_t lowerBound(int x) const {
+        if (distinct == 0) return 0;
+        size_t i = 0;       // block within the current layer
+        size_t layers = layerStart.size();
+        for (size_t k = 0; k + 1 < layers; k++) {
+            i = i * (B + 1) + rank(blocks[layerStart[k] + i], x);
+        }
+        size_t pos = i * B + rank(blocks[layerStart[layers - 1] + i], x);
+        return pos < distinct ? pos : distinct;
+    }
+
+    // The pos-th distinct salary, read from the leaf layer
+    int keyAt(size_t pos) const {
+        return blocks[layerStart.back() + pos / B].keys[pos % B];
+    }
+
+    size_t upperBound(int x) const {
+        return x == INT_MAX ? distinct : lowerBound(x + 1);
+    }
+
+    void build() {
+        for (size_t i = 0; i < records.size(); i++) {
+            if (i == 0 || records[i].salary != records[i - 1].salary) offsets.push_back(i);
+        }
+        distinct = offsets.size();
+        offsets.push_back(records.size());
+
+        // Layer sizes from the leaves up; each inner node has B + 1 children.
+        vector<size_t> sizes{ max<size_t>(1, (distinct + B - 1) / B) };
+        while (sizes.back() > 1) sizes.push_back((sizes.back() + B) / (B + 1));
+        size_t total = 0;
+        for (size_t k = sizes.size(); k-- > 0;) {
+            layerStart.push_back(total);
+            total += sizes[k];
+        }
+        blocks.resize(total);
+
+        keyBlock* leaves = &blocks[layerStart.back()];
+        for (size_t i = 0; i < sizes[0] * B; i++) {
+            leaves[i / B].keys[i % B] = i < distinct ? records[offsets[i]].salary : INT_MAX;
+        }
+        // Key j of an inner node is the smallest salary under child j + 1,
+        // which is the first key of that child's leftmost leaf.
+        size_t span = 1;    // leaves under one node of the layer below
+        for (size_t level = 1; level < sizes.size(); level++) {
+            keyBlock* layer = &blocks[layerStart[sizes.size() - 1 - level]];
+            for (size_t i = 0; i < sizes[level]; i++) {
+                for (int j = 0; j < B; j++) {
+                    size_t leaf = (i * (B + 1) + j + 1) * span;
+                    layer[i].keys[j] = leaf < sizes[0] ? leaves[leaf].keys[0] : INT_MAX;
+                }
+            }
+            span *= B + 1;
+        }
+    }
+
+public:
+    SalaryIndex() {
+        build();
+    }
+
+    // Indexes the employees in [first, last), e.g. a tree's begin() and end().
+    template<typename InputIt>
+    SalaryIndex(InputIt first, InputIt last) : records(first, last) {
+        if (!is_sorted(records.begin(), records.end())) {
+            stable_sort(records.begin(), records.end());
+        }
+        build();
+    }
+
+    size_t size() const { return records.size(); }
+    const Employee* begin() const { return records.data(); }
+    const Employee* end() const { return records.data() + records.size(); }
+
+    const Employee* find(int x) const {
+        EmployeeSpan all = findAll(x);
+        return all.empty() ? nullptr : all.begin();
+    }
+
+    EmployeeSpan findAll(int x) const {
+        size_t pos = lowerBound(x);
+        if (pos == distinct || keyAt(pos) != x) return EmployeeSpan();
+        return EmployeeSpan(records.data() + offsets[pos], offsets[pos + 1] - offsets[pos]);
+    }
+
+    // Every employee with a salary in [min, max], which is always contiguous
+    EmployeeSpan inRange(int min, int max) const {
+        if (min > max) return EmployeeSpan();
+        size_t first = offsets[lowerBound(min)];
+        size_t last = offsets[upperBound(max)];
+        return EmployeeSpan(records.data() + first, last - first);
+    }
+
+    template<typename Visitor>
+    void forEachInRange(int min, int max, Visitor visit) const {
+        for (const Employee& e : inRange(min, max)) visit(e);
+    }
+
+    template<typename OutputIt>
+    OutputIt copyInRange(int min, int max, OutputIt out) const {
+        EmployeeSpan range = inRange(min, max);
+        return copy(range.begin(), range.end(), out);
+    }
+
+    vector<Employee> findInRange(int min, int max) const {
+        EmployeeSpan range = inRange(min, max);
+        return vector<Employee>(range.begin(), range.end());
+    }
+
+    void printInRange(int min, int max, ostream& os = cout) const {
+        for (const Employee& e : inRange(min, max)) os << e << '\n';
+        os.flush();
+    }
+};
+
+/* A read-only memory mapping of a whole file. */
+class MappedFile {
+    const char* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    // Maps path; returns false if it cannot be opened or is empty.
+    bool open(const string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            close();
+            return false;
+        }
+        base = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        length = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);        // the mapping keeps the file alive
+        if (p == MAP_FAILED) return false;
+        base = static_cast<const char*>(p);
+        length = (size_t)info.st_size;
+#endif
+        if (base == nullptr) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (base != nullptr) UnmapViewOfFile(base);
+        if (mapping != nullptr) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base != nullptr) munmap(const_cast<char*>(base), length);
+#endif
+        base = nullptr;
+        length = 0;
+    }
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+};
+
+/* A versioned binary snapshot of a roster. The file is a 64-byte header,
+then fixed-size 16-byte records sorted by salary, then a string table of
+offsets into a string heap. Strings are numbered per snapshot, so a file
+does not depend on the StringPool ids of the process that wrote it.
+
+open() maps the file and checks the header and the string table, never
+the records, so it costs one pass over the distinct names. Queries then
+binary-search the mapped records and read names straight out of the
+mapped heap, without building any Employee objects. employees() converts
+the records when a mutable tree is needed, interning each distinct string
+once. */
+class Snapshot {
+public:
+    static constexpr uint32_t currentVersion = 1;
+
+    struct header {
+        char magic[8];          // "EMPSNAP" and a zero byte
+        uint32_t version;
+        uint32_t byteOrder;     // 0x01020304 as written by the saving machine
+        uint64_t recordCount;
+        uint64_t stringCount;
+        uint64_t heapBytes;
+        uint64_t logSequence;   // last WriteAheadLog record the snapshot includes
+        uint64_t reserved[2];
+    };
+
+    struct record {
+        int32_t salary;
+        uint32_t firstName;     // indexes into the string table
+        uint32_t lastName;
+        uint32_t jobTitle;
+    };
+
+    // One employee as seen through the mapping
+    struct row {
+        int salary;
+        string_view firstName;
+        string_view lastName;
+        string_view jobTitle;
+
+        friend ostream& operator<<(ostream& os, const row& obj) {
+            os << obj.firstName << " " << obj.lastName << ", " << obj.jobTitle << " ($" << obj.salary << ")";
+            return os;
+        }
+    };
+
+private:
+    static constexpr char magicBytes[8] = { 'E', 'M', 'P', 'S', 'N', 'A', 'P', '\0' };
+    static constexpr uint32_t byteOrderMark = 0x01020304;
+
+    MappedFile file;
+    const header* head = nullptr;
+    const record* records = nullptr;
+    const uint64_t* stringOffsets = nullptr;    // stringCount + 1 entries
+    const char* heap = nullptr;
+
+    string_view stringAt(uint32_t id) const {
+        if (id >= head->stringCount) throw runtime_error("Snapshot string id out of range");
+        return string_view(heap + stringOffsets[id], size_t(stringOffsets[id + 1] - stringOffsets[id]));
+    }
+
+    const record* lowerBound(int salary) const {
+        return std::lower_bound(records, records + head->recordCount, salary,
+            [](const record& r, int x) { return r.salary < x; });
+    }
+
+    // Forces the contents of the file at path out to disk
+    static void syncFile(const string& path) {
+#ifdef _WIN32
+        HANDLE h = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        bool synced = h != INVALID_HANDLE_VALUE && FlushFileBuffers(h);
+        if (h != INVALID_HANDLE_VALUE) CloseHandle(h);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        bool synced = fd >= 0 && fsync(fd) == 0;
+        if (fd >= 0) ::close(fd);
+#endif
+        if (!synced) throw runtime_error("Could not sync " + path);
+    }
+
+    // Forces the directory entry naming path out to disk, so a rename onto
+    // it survives a crash. On Windows MOVEFILE_WRITE_THROUGH does this.
+    static void syncDirectory(const string& path) {
+#ifndef _WIN32
+        size_t slash = path.rfind('/');
+        string directory = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        int fd = ::open(directory.c_str(), O_RDONLY);
+        bool synced = fd >= 0 && fsync(fd) == 0;
+        if (fd >= 0) ::close(fd);
+        if (!synced) throw runtime_error("Could not sync " + directory);
+#endif
+    }
+
+public:
+    /* Writes [first, last) to path and returns the number of employees
+    written. logSequence records how much of a WriteAheadLog it covers. The
+    file is written next to path, synced, renamed over it and the rename
+    synced, so a crash leaves the old snapshot or the new one, never a torn
+    one, and the new one is on disk by the time save() returns. */
+    template<typename InputIt>
+    static size_t save(const string& path, InputIt first, InputIt last, uint64_t logSequence = 0) {
+        vector<record> rows;
+        vector<uint32_t> poolIds;               // snapshot string id -> StringPool id
+        unordered_map<uint32_t, uint32_t> localIds;
+        auto local = [&](InternedString s) {
+            auto found = localIds.emplace(s.id(), (uint32_t)poolIds.size());
+            if (found.second) poolIds.push_back(s.id());
+            return found.first->second;
+        };
+        for (; first != last; ++first) {
+            const Employee& e = *first;
+            rows.push_back({ e.salary, local(e.firstName), local(e.lastName), local(e.jobTitle) });
+        }
+        stable_sort(rows.begin(), rows.end(), [](const record& a, const record& b) { return a.salary < b.salary; });
+
+        vector<uint64_t> offsets{ 0 };
+        offsets.reserve(poolIds.size() + 1);
+        for (uint32_t id : poolIds) offsets.push_back(offsets.back() + StringPool::shared().view(id).size());
+
+        header h{};
+        copy(begin(magicBytes), end(magicBytes), h.magic);
+        h.version = currentVersion;
+        h.byteOrder = byteOrderMark;
+        h.recordCount = rows.size();
+        h.stringCount = poolIds.size();
+        h.heapBytes = offsets.back();
+        h.logSequence = logSequence;
+
+        string temp = path + ".tmp";
+        {
+            ofstream out(temp, ios::binary | ios::trunc);
+            if (!out) throw runtime_error("Could not write " + temp);
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            out.write(reinterpret_cast<const char*>(rows.data()), streamsize(rows.size() * sizeof(record)));
+            out.write(reinterpret_cast<const char*>(offsets.data()), streamsize(offsets.size() * sizeof(uint64_t)));
+            for (uint32_t id : poolIds) {
+                string_view s = StringPool::shared().view(id);
+                out.write(s.data(), streamsize(s.size()));
+            }
+            out.flush();
+            if (!out) throw runtime_error("Could not write " + temp);
+        }
+        syncFile(temp);         // before the rename, or a crash could leave path naming an empty file
+#ifdef _WIN32
+        if (!MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+#else
+        if (rename(temp.c_str(), path.c_str()) != 0) {
+#endif
+            throw runtime_error("Could not replace " + path);
+        }
+        syncDirectory(path);
+        return rows.size();
+    }
+
+    /* Maps path. Returns false if there is no such file, and throws if the
+    file is not a snapshot this build can read. */
+    bool open(const string& path) {
+        head = nullptr;
+        if (!file.open(path)) return false;
+        const char* base = file.data();
+        if (file.size() < sizeof(header)) throw runtime_error(path + " is not a snapshot");
+        const header* h = reinterpret_cast<const header*>(base);
+        if (!equal(begin(magicBytes), end(magicBytes), h->magic)) throw runtime_error(path + " is not a snapshot");
+        if (h->byteOrder != byteOrderMark) throw runtime_error(path + " was written on a machine with another byte order");
+        if (h->version != currentVersion) throw runtime_error(path + " has unsupported snapshot version " + to_string(h->version));
+        // Each count is bounded by the file first, so the sum cannot overflow
+        if (h->recordCount > file.size() / sizeof(record) || h->stringCount >= file.size() / sizeof(uint64_t)
+            || h->heapBytes > file.size()) {
+            throw runtime_error(path + " is truncated or corrupt");
+        }
+        uint64_t expected = sizeof(header) + h->recordCount * sizeof(record)
+            + (h->stringCount + 1) * sizeof(uint64_t) + h->heapBytes;
+        if (file.size() != expected) throw runtime_error(path + " is truncated or corrupt");
+
+        // stringAt() trusts the offsets, so they must climb from 0 and stay inside the heap
+        const uint64_t* offsets = reinterpret_cast<const uint64_t*>(base + sizeof(header) + h->recordCount * sizeof(record));
+        if (offsets[0] != 0) throw runtime_error(path + " has a corrupt string table");
+        for (uint64_t i = 0; i < h->stringCount; i++) {
+            if (offsets[i + 1] < offsets[i] || offsets[i + 1] > h->heapBytes) throw runtime_error(path + " has a corrupt string table");
+        }
+
+        head = h;
+        records = reinterpret_cast<const record*>(base + sizeof(header));
+        stringOffsets = offsets;
+        heap = reinterpret_cast<const char*>(stringOffsets + h->stringCount + 1);
+        return true;
+    }
+
+    size_t size() const { return head == nullptr ? 0 : size_t(head->recordCount); }
+    uint64_t logSequence() const { return head == nullptr ? 0 : head->logSequence; }
+
+    row at(size_t i) const {
+        const record& r = records[i];
+        return { r.salary, stringAt(r.firstName), stringAt(r.lastName), stringAt(r.jobTitle) };
+    }
+
+    // Calls visit(row) on every record with a salary in [min, max], in order.
+    template<typename Visitor>
+    void forEachInRange(int min, int max, Visitor visit) const {
+        if (head == nullptr) return;
+        const record* end = records + head->recordCount;
+        for (const record* r = lowerBound(min); r != end && r->salary <= max; ++r) {
+            visit(at(size_t(r - records)));
+        }
+    }
+
+    void printInRange(int min, int max, ostream& os = cout) const {
+        forEachInRange(min, max, [&os](const row& r) { os << r << '\n'; });
+        os.flush();
+    }
+
+    // Every record as an Employee, in salary order, ready for bulkLoad.
+    vector<Employee> employees() const {
+        vector<Employee> out;
+        if (head == nullptr) return out;
+        vector<InternedString> strings;
+        strings.reserve(size_t(head->stringCount));
+        for (uint32_t id = 0; id < head->stringCount; id++) strings.emplace_back(stringAt(id));
+        out.reserve(size());
+        for (size_t i = 0; i < size(); i++) {
+            const record& r = records[i];
+            if (max(r.firstName, max(r.lastName, r.jobTitle)) >= strings.size()) {
+                throw runtime_error("Snapshot string id out of range");
+            }
+            out.emplace_back(strings[r.firstName], strings[r.lastName], strings[r.jobTitle], r.salary);
+        }
+        return out;
+    }
+};
+
+/* An append-only log of the inserts and removes made since the last
+snapshot, so a crash loses nothing that was acknowledged.
+
+append() only encodes the record into a buffer. A background thread writes
+the buffer and syncs the file once per commit interval, or as soon as the
+buffer fills or a caller is waiting, so one fsync covers every record
+appended since the previous one (group commit). A caller that must not
+answer before its change is on disk passes the sequence number append()
+returned to waitDurable().
+
+Each record carries a sequence number and a checksum. open() replays the
+records newer than the snapshot and cuts the file off at the first torn or
+corrupt record. compact() writes a snapshot holding everything logged so
+far and empties the log only once the snapshot and its rename are synced.
+A crash between the two steps is harmless, since the snapshot remembers
+the last sequence number it includes and replay skips everything up to it. */
+class WriteAheadLog {
+public:
+    enum operation : uint8_t { logInsert = 1, logRemove = 2 };
+
+    static constexpr size_t compactBytes = size_t(64) << 20;   // log size at which compactIfDue() compacts
+    static constexpr size_t flushBytes = size_t(1) << 20;      // buffered bytes that wake the flusher early
+
+private:
+    static constexpr char magicBytes[8] = { 'E', 'M', 'P', 'W', 'A', 'L', '\0', '\0' };
+    static constexpr uint32_t currentVersion = 1;
+    static constexpr uint32_t byteOrderMark = 0x01020304;
+    static constexpr size_t headerSize = 16;    // magic, version, byte order
+    static constexpr size_t frameSize = 8;      // checksum and body length ahead of every record
+    static constexpr size_t fixedBody = 25;     // sequence, operation, salary, three string lengths
+
+    string snapshotPath;
+    string logPath;
+    chrono::milliseconds commitInterval;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    int file = -1;
+#endif
+    mutex io;                   // one writer of the file at a time: the flusher or compact()
+
+    mutex lock;                 // guards everything below
+    condition_variable wake;    // tells the flusher there is work
+    condition_variable durable; // tells waiters durableSequence moved
+    string pending;             // records appended but not yet written
+    string writing;             // records being written, swapped with pending
+    uint64_t nextSequence = 1;
+    uint64_t durableSequence = 0;
+    uint64_t logBytes = 0;      // size of the log including pending records
+    size_t waiting = 0;
+    bool stopping = false;
+    bool failed = false;        // a write failed; every later call throws
+    thread flusher;
+
+    template<typename T>
+    static void put(string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    static T get(const char* p) {
+        T value;
+        memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    // 32-bit FNV-1a
+    static uint32_t checksum(const char* p, size_t n) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < n; i++) hash = (hash ^ (unsigned char)p[i]) * 16777619u;
+        return hash;
+    }
+
+    void writeAll(const char* data, size_t size) {
+        while (size > 0) {
+#ifdef _WIN32
+            DWORD written = 0;
+            DWORD chunk = (DWORD)min<size_t>(size, 1u << 30);
+            if (!WriteFile(file, data, chunk, &written, nullptr)) throw runtime_error("Could not write " + logPath);
+#else
+            ssize_t written = ::write(file, data, size);
+            if (written < 0 && errno == EINTR) continue;
+            if (written < 0) throw runtime_error("Could not write " + logPath);
+#endif
+            data += written;
+            size -= size_t(written);
+        }
+    }
+
+    void syncFile() {
+#ifdef _WIN32
+        if (!FlushFileBuffers(file)) throw runtime_error("Could not sync " + logPath);
+#else
+        if (fsync(file) != 0) throw runtime_error("Could not sync " + logPath);
+#endif
+    }
+
+    // Cuts the file to length bytes and moves the write position to its end
+    void resize(uint64_t length) {
+#ifdef _WIN32
+        LARGE_INTEGER position;
+        position.QuadPart = (LONGLONG)length;
+        if (!SetFilePointerEx(file, position, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+            throw runtime_error("Could not truncate " + logPath);
+        }
+#else
+        if (ftruncate(file, (off_t)length) != 0 || lseek(file, (off_t)length, SEEK_SET) < 0) {
+            throw runtime_error("Could not truncate " + logPath);
+        }
+#endif
+    }
+
+    // Writes and syncs everything appended so far. The caller holds io.
+    void flushPending() {
+        uint64_t upTo;
+        {
+            lock_guard<mutex> guard(lock);
+            if (failed) throw runtime_error("Could not write " + logPath);
+            writing.clear();
+            writing.swap(pending);
+            upTo = nextSequence - 1;
+        }
+        try {
+            if (!writing.empty()) {
+                writeAll(writing.data(), writing.size());
+                syncFile();
+            }
+        }
+        catch (const runtime_error&) {
+            lock_guard<mutex> guard(lock);
+            failed = true;
+            durable.notify_all();
+            throw;
+        }
+        lock_guard<mutex> guard(lock);
+        durableSequence = max(durableSequence, upTo);
+        durable.notify_all();
+    }
+
+    void flushLoop() {
+        unique_lock<mutex> guard(lock);
+        while (!stopping && !failed) {
+            wake.wait_for(guard, commitInterval, [this] {
+                return stopping || (!pending.empty() && (waiting > 0 || pending.size() >= flushBytes));
+            });
+            if (pending.empty()) continue;
+            guard.unlock();
+            try {
+                lock_guard<mutex> writer(io);
+                flushPending();
+            }
+            catch (const runtime_error&) {}     // failed is set; callers see it
+            guard.lock();
+        }
+    }
+
+    /* Calls apply(operation, const Employee&) for every intact record in
+    the log newer than sequence after, counting them in applied and raising
+    last to the highest sequence seen. Returns the end of the last intact
+    record, 0 if there is no log. Throws if the file is not a log. */
+    template<typename Apply>
+    size_t scan(uint64_t after, Apply apply, size_t& applied, uint64_t& last) const {
+        string contents;
+        {
+            ifstream in(logPath, ios::binary);
+            if (in) contents.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        }
+        size_t good = 0;        // end of the last intact record
+        if (contents.size() >= headerSize) {
+            if (!equal(begin(magicBytes), end(magicBytes), contents.data())) throw runtime_error(logPath + " is not a log");
+            if (get<uint32_t>(contents.data() + 12) != byteOrderMark) {
+                throw runtime_error(logPath + " was written on a machine with another byte order");
+            }
+            uint32_t version = get<uint32_t>(contents.data() + 8);
+            if (version != currentVersion) throw runtime_error(logPath + " has unsupported log version " + to_string(version));
+            good = headerSize;
+            while (good + frameSize <= contents.size()) {
+                const char* frame = contents.data() + good;
+                uint32_t sum = get<uint32_t>(frame);
+                uint32_t length = get<uint32_t>(frame + 4);
+                if (length < fixedBody || length > contents.size() - good - frameSize) break;
+                const char* body = frame + frameSize;
+                if (checksum(body, length) != sum) break;
+                uint32_t lengths[3];
+                for (int i = 0; i < 3; i++) lengths[i] = get<uint32_t>(body + 13 + 4 * i);
+                if (uint64_t(lengths[0]) + lengths[1] + lengths[2] != length - fixedBody) break;
+
+                uint64_t sequence = get<uint64_t>(body);
+                if (sequence > after) {
+                    const char* text = body + fixedBody;
+                    string_view first(text, lengths[0]);
+                    string_view lastName(text + lengths[0], lengths[1]);
+                    string_view title(text + lengths[0] + lengths[1], lengths[2]);
+                    apply(operation(body[8]), Employee(first, lastName, title, get<int32_t>(body + 9)));
+                    applied++;
+                }
+                last = max(last, sequence);
+                good += frameSize + length;
+            }
+        }
+        return good;
+    }
+
+public:
+    // Logs changes to the tree saved at snapshotPath, in snapshotPath + ".wal"
+    WriteAheadLog(const string& snapshotPath, chrono::milliseconds commitInterval = chrono::milliseconds(10)) :
+        snapshotPath(snapshotPath), logPath(snapshotPath + ".wal"), commitInterval(commitInterval) {}
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    ~WriteAheadLog() {
+        if (flusher.joinable()) {
+            {
+                lock_guard<mutex> guard(lock);
+                stopping = true;
+            }
+            wake.notify_one();
+            flusher.join();
+            try {
+                lock_guard<mutex> writer(io);
+                flushPending();
+            }
+            catch (const runtime_error&) {}
+        }
+#ifdef _WIN32
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (file >= 0) ::close(file);
+#endif
+    }
+
+    /* Replays every record newer than sequence after, calling
+    apply(operation, const Employee&) for each, then opens the log for
+    appending and starts the flusher. Returns the number of records
+    replayed. Throws if the file exists but is not a log. */
+    template<typename Apply>
+    size_t open(uint64_t after, Apply apply) {
+        size_t applied = 0;
+        uint64_t last = after;
+        size_t good = scan(after, apply, applied, last);
+
+#ifdef _WIN32
+        file = CreateFileA(logPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) throw runtime_error("Could not open " + logPath);
+#else
+        file = ::open(logPath.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (file < 0) throw runtime_error("Could not open " + logPath);
+#endif
+        resize(good);           // drop a torn tail
+        if (good == 0) {
+            string header(magicBytes, sizeof(magicBytes));
+            put(header, currentVersion);
+            put(header, byteOrderMark);
+            writeAll(header.data(), header.size());
+            good = headerSize;
+        }
+        syncFile();
+
+        nextSequence = last + 1;
+        durableSequence = last;
+        logBytes = good;
+        flusher = thread(&WriteAheadLog::flushLoop, this);
+        return applied;
+    }
+
+    // Replays like open() but only reads the log, for a process that will
+    // not write: no file is created or cut and no flusher starts.
+    template<typename Apply>
+    size_t replay(uint64_t after, Apply apply) const {
+        size_t applied = 0;
+        uint64_t last = after;
+        scan(after, apply, applied, last);
+        return applied;
+    }
+
+    // Buffers one record and returns its sequence number
+    uint64_t append(operation op, const Employee& e) {
+        string_view strings[3] = { e.firstName.view(), e.lastName.view(), e.jobTitle.view() };
+        lock_guard<mutex> guard(lock);
+        if (failed) throw runtime_error("Could not write " + logPath);
+        uint64_t sequence = nextSequence++;
+        size_t start = pending.size();
+        pending.append(frameSize, '\0');
+        put(pending, sequence);
+        put(pending, uint8_t(op));
+        put(pending, int32_t(e.salary));
+        for (string_view s : strings) put(pending, uint32_t(s.size()));
+        for (string_view s : strings) pending.append(s.data(), s.size());
+        uint32_t length = uint32_t(pending.size() - start - frameSize);
+        uint32_t sum = checksum(pending.data() + start + frameSize, length);
+        memcpy(&pending[start], &sum, sizeof(sum));
+        memcpy(&pending[start + 4], &length, sizeof(length));
+        logBytes += pending.size() - start;
+        if (pending.size() >= flushBytes) wake.notify_one();
+        return sequence;
+    }
+
+    // Blocks until the record with this sequence number is on disk
+    void waitDurable(uint64_t sequence) {
+        unique_lock<mutex> guard(lock);
+        waiting++;
+        wake.notify_one();
+        durable.wait(guard, [&] { return durableSequence >= sequence || failed; });
+        waiting--;
+        if (durableSequence < sequence) throw runtime_error("Could not write " + logPath);
+    }
+
+    // Sequence number of the last record appended
+    uint64_t lastSequence() {
+        lock_guard<mutex> guard(lock);
+        return nextSequence - 1;
+    }
+
+    uint64_t size() {
+        lock_guard<mutex> guard(lock);
+        return logBytes;
+    }
+
+    /* Saves [first, last) as the snapshot and empties the log. The range
+    must reflect every record appended so far, so the tree must not change
+    while this runs. */
+    template<typename InputIt>
+    void compact(InputIt first, InputIt last) {
+        lock_guard<mutex> writer(io);
+        flushPending();
+        Snapshot::save(snapshotPath, first, last, lastSequence());  // returns once the snapshot is on disk
+        resize(headerSize);
+        syncFile();
+        lock_guard<mutex> guard(lock);
+        logBytes = headerSize + pending.size();
+    }
+
+    template<typename InputIt>
+    void compactIfDue(InputIt first, InputIt last) {
+        if (size() >= compactBytes) compact(first, last);
+    }
+};
+
+/* Reads and writes rosters as CSV, one employee per line in the order
+firstName,lastName,jobTitle,salary. Fields may be quoted as in RFC 4180, so
+names can hold commas, quotes and line breaks. A first line whose salary
+is not a number is taken as a header and skipped.
+
+read() maps the file and hands out string_views into the mapping, so a
+field costs no allocation; quoted fields are unescaped into one reused buffer.
+Lines without quotes are split with memchr, which keeps the common case
+well above the speed of the disk. write() builds its output in a large
+buffer and never flushes per line. */
+class Csv {
+    static constexpr size_t bufferSize = size_t(1) << 20;
+
+    // True if s must be quoted to survive a round trip
+    static bool needsQuotes(string_view s) {
+        for (char c : s) {
+            if (c == ',' || c == '"' || c == '\r' || c == '\n') return true;
+        }
+        return false;
+    }
+
+    // Writes s at w, quoted if it needs to be, and returns the new end.
+    // There must be room for 2 * s.size() + 2 characters.
+    static char* putField(char* w, string_view s) {
+        if (!needsQuotes(s)) {
+            memcpy(w, s.data(), s.size());
+            return w + s.size();
+        }
+        *w++ = '"';
+        for (char c : s) {
+            if (c == '"') *w++ = '"';
+            *w++ = c;
+        }
+        *w++ = '"';
+        return w;
+    }
+
+    /* Remembers recently read strings so a name that repeats down the file,
+    as names do, is looked up without going through the StringPool lock and
+    hash table. Direct-mapped: a collision just replaces the slot. Short
+    strings are kept in the slot itself so a hit touches one cache line. */
+    class internCache {
+        static constexpr size_t inlineBytes = 19;
+
+        struct slot {
+            uint32_t hash = 0;
+            InternedString value;
+            uint8_t length = 0xff;      // 0xff: too long to keep inline, compare against the pool
+            char text[inlineBytes];
+        };
+        vector<slot> slots = vector<slot>(size_t(1) << 14);
+
+    public:
+        InternedString operator()(string_view s) {
+            uint32_t hash = 2166136261u;
+            for (char c : s) hash = (hash ^ (unsigned char)c) * 16777619u;
+            slot& entry = slots[hash & (slots.size() - 1)];
+            if (entry.hash == hash) {
+                // Check the marker first: a 255-byte string would match it as a length
+                if (entry.length == 0xff) {
+                    if (entry.value.view() == s) return entry.value;
+                }
+                else if (entry.length == s.size() && memcmp(entry.text, s.data(), s.size()) == 0) {
+                    return entry.value;
+                }
+            }
+            entry.hash = hash;
+            entry.value = InternedString(s);
+            entry.length = s.size() <= inlineBytes ? uint8_t(s.size()) : 0xff;
+            if (s.size() <= inlineBytes) memcpy(entry.text, s.data(), s.size());
+            return entry.value;
+        }
+    };
+
+    /* Splits the record starting at p into fields and returns the start of
+    the next record. Quoted fields are unescaped into scratch; their views
+    are filled in at the end, once scratch has stopped growing. */
+    static const char* splitQuoted(const char* p, const char* end, vector<string_view>& fields, string& scratch) {
+        scratch.clear();
+        vector<pair<size_t, size_t>> quoted;    // field index, start in scratch
+        auto finish = [&](const char* next) {
+            for (size_t i = 0; i < quoted.size(); i++) {
+                size_t stop = i + 1 < quoted.size() ? quoted[i + 1].second : scratch.size();
+                fields[quoted[i].first] = string_view(scratch.data() + quoted[i].second, stop - quoted[i].second);
+            }
+            return next;
+        };
+        while (true) {
+            if (p < end && *p == '"') {
+                quoted.emplace_back(fields.size(), scratch.size());
+                for (p++; p < end; p++) {
+                    if (*p == '"') {
+                        if (p + 1 < end && p[1] == '"') {
+                            scratch += '"';
+                            p++;
+                        }
+                        else {
+                            p++;
+                            break;
+                        }
+                    }
+                    else {
+                        scratch += *p;
+                    }
+                }
+                fields.push_back(string_view());
+                // Anything between the closing quote and the delimiter is ignored
+                while (p < end && *p != ',' && *p != '\n') p++;
+            }
+            else {
+                const char* start = p;
+                while (p < end && *p != ',' && *p != '\n') p++;
+                const char* stop = p;
+                if (stop > start && stop[-1] == '\r' && (p == end || *p == '\n')) stop--;
+                fields.push_back(string_view(start, size_t(stop - start)));
+            }
+            if (p == end) return finish(end);
+            if (*p++ == '\n') return finish(p);
+        }
+    }
+
+public:
+    /* Calls visit(Employee&&) for every row of the file at path and returns
+    the number of rows. Throws runtime_error naming the line of the first
+    malformed row. */
+    template<typename Visitor>
+    static size_t read(const string& path, Visitor visit) {
+        MappedFile file;
+        if (!file.open(path)) {
+            ifstream probe(path);
+            if (!probe) throw runtime_error("Could not open " + path);
+            return 0;       // an empty file
+        }
+        const char* p = file.data();
+        const char* end = p + file.size();
+        vector<string_view> fields;
+        string scratch;
+        internCache intern[3];      // one per column, since names rarely turn up as titles
+        size_t line = 0;            // where the current record starts
+        size_t nextLine = 1;
+        size_t rows = 0;
+        while (p < end) {
+            line = nextLine++;
+            const char* next = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+            const char* stop = next == nullptr ? end : next;
+            fields.clear();
+            if (memchr(p, '"', size_t(stop - p)) != nullptr) {
+                const char* start = p;
+                p = splitQuoted(p, end, fields, scratch);
+                nextLine += size_t(count(start, p, '\n')) - (p[-1] == '\n' ? 1 : 0);
+            }
+            else {
+                const char* lineEnd = (stop > p && stop[-1] == '\r') ? stop - 1 : stop;
+                for (const char* field = p;;) {
+                    const char* comma = static_cast<const char*>(memchr(field, ',', size_t(lineEnd - field)));
+                    if (comma == nullptr) {
+                        fields.push_back(string_view(field, size_t(lineEnd - field)));
+                        break;
+                    }
+                    fields.push_back(string_view(field, size_t(comma - field)));
+                    field = comma + 1;
+                }
+                p = next == nullptr ? end : next + 1;
+            }
+            if (fields.size() == 1 && fields[0].empty()) continue;      // blank line
+
+            int salary = 0;
+            bool numeric = false;
+            if (fields.size() == 4) {
+                auto result = from_chars(fields[3].data(), fields[3].data() + fields[3].size(), salary);
+                numeric = result.ec == errc() && result.ptr == fields[3].data() + fields[3].size();
+            }
+            if (!numeric) {
+                if (line == 1 && fields.size() == 4) continue;          // header
+                throw runtime_error(path + " line " + to_string(line) + ": expected firstName,lastName,jobTitle,salary");
+            }
+            visit(Employee(intern[0](fields[0]), intern[1](fields[1]), intern[2](fields[2]), salary));
+            rows++;
+        }
+        return rows;
+    }
+
+    // Reads the file at path into a vector, in file order
+    static vector<Employee> read(const string& path) {
+        vector<Employee> roster;
+        read(path, [&roster](Employee&& e) { roster.push_back(std::move(e)); });
+        return roster;
+    }
+
+    /* Writes a header and then [first, last) to path. Returns the number of
+    employees written. */
+    template<typename InputIt>
+    static size_t write(const string& path, InputIt first, InputIt last) {
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) throw runtime_error("Could not write " + path);
+        const string header = "firstName,lastName,jobTitle,salary\n";
+        vector<char> buffer(max(bufferSize, header.size()));
+        size_t used = header.copy(buffer.data(), header.size());
+        size_t rows = 0;
+        for (; first != last; ++first) {
+            const Employee& e = *first;
+            string_view fields[3] = { e.firstName.view(), e.lastName.view(), e.jobTitle.view() };
+            // Room for the worst case: every character a doubled quote
+            size_t longest = 2 * (fields[0].size() + fields[1].size() + fields[2].size()) + 6 + 3 + 12;
+            if (longest > buffer.size() - used) {
+                out.write(buffer.data(), streamsize(used));
+                used = 0;
+                if (longest > buffer.size()) buffer.resize(longest);
+            }
+            char* w = buffer.data() + used;
+            for (string_view field : fields) {
+                w = putField(w, field);
+                *w++ = ',';
+            }
+            w = to_chars(w, w + 11, e.salary).ptr;
+            *w++ = '\n';
+            used = size_t(w - buffer.data());
+            rows++;
+        }
+        out.write(buffer.data(), streamsize(used));
+        out.flush();
+        if (!out) throw runtime_error("Could not write " + path);
+        return rows;
+    }
 };
 
 /* The UI class contains functions relating to the UI of the
@@ -452,6 +3649,7 @@ the same namespace. */
 class UI {
 private:
     EmployeeRBT* employees = nullptr;
+    WriteAheadLog* log = nullptr;   // every change is logged, and compacted on quit, when set
 
     bool isBetween(int num, int* min, int* max) {
         if (min != nullptr && num < *min) return false;
@@ -497,9 +3695,10 @@ private:
     }
 
 public:
-    UI(EmployeeRBT* rbt) : employees(rbt) {}
+    UI(EmployeeRBT* rbt, WriteAheadLog* log = nullptr) : employees(rbt), log(log) {}
 
-    void mainMenu() {
+    // Runs one menu choice; false once the user quits
+    bool mainMenu() {
         cout << "----------------------------------" << endl;
         cout << "What would you like to do?" << endl;
         cout << "  1) Add an employee" << endl;
@@ -521,16 +3720,23 @@ public:
             searchEmployee();
             break;
         case 4:
-            exit(0);
+            if (log != nullptr) log->compact(employees->begin(), employees->end());
+            return false;   // main returns, so the log's flusher is stopped and joined
         default:
             throw runtime_error("How did we get here?!?!\n");
             break;
         }
+        return true;
     }
 
     void addEmployee() {
         Employee e = inputEmployee();
+        uint64_t sequence = log == nullptr ? 0 : log->append(WriteAheadLog::logInsert, e);
         employees->insert(e);
+        if (log != nullptr) {
+            log->waitDurable(sequence);
+            log->compactIfDue(employees->begin(), employees->end());
+        }
         cout << "Successfully inserted " << e.firstName << " " << e.lastName << " into the database" << endl;
     }
 
@@ -539,7 +3745,7 @@ public:
         int max = 200000;
         cout << "Select a salary to search for." << endl;
         int salary = inputInteger(&min, &max);
-        vector<Employee> v = employees->findAll(salary);
+        EmployeeSpan v = employees->findAll(salary);
         Employee z;
         int n = v.size();
         if (n == 0) {
@@ -565,7 +3771,12 @@ public:
         min = 1;
         max = 2;
         if (inputInteger(&min, &max) == 1) {
+            uint64_t sequence = log == nullptr ? 0 : log->append(WriteAheadLog::logRemove, z);
             employees->remove(z);
+            if (log != nullptr) {
+                log->waitDurable(sequence);
+                log->compactIfDue(employees->begin(), employees->end());
+            }
             cout << "Deleted " << z << endl;
         }
         else {
@@ -579,6 +3790,215 @@ public:
         cout << "Enter a maximum value." << endl;
         int max = inputInteger(&min, nullptr);
         employees->printInRange(min, max);
+        SalaryStats stats = employees->summarize(min, max);
+        cout << stats.count << " employees, total payroll $" << stats.total
+            << ", average $" << fixed << setprecision(2) << stats.average() << defaultfloat << endl;
+    }
+};
+
+/* Non-interactive counterpart to UI, for scripts and for replaying a day
+of HR operations at full speed. Reads one tab-separated command per line
+and answers every command with tab-separated lines:
+
+    add <salary> <first> <last> <title>       ok
+    delete <salary> <first> <last> <title>    ok | missing
+    find <salary>                             found <n>, then n records
+    range <min> <max>                         found <n>, then n records
+    name <first|last|title> <name>            found <n>, then n records
+    prefix <first|last|title> <prefix>        found <n>, then n records
+    count <min> <max>                         count <n>
+    payroll <min> <max>                       payroll <n> <total> <lowest> <highest>
+    percentile <0 to 100>                     salary <s> | missing
+
+Records are written as <salary> <first> <last> <title>; payroll reports
+0 for lowest and highest when nobody earns a salary in the band. A malformed line
+is answered with "error <line number> <reason>"; blank lines and lines
+starting with # get no answer. Commands are read and answered in batches,
+with one write per batch instead of a flush per line. */
+class BatchUI {
+    EmployeeRBT* employees = nullptr;
+    WriteAheadLog* log = nullptr;   // changes are logged, and acknowledged once per batch, when set
+    string out;                 // answers for the current batch
+    vector<string_view> fields; // fields of the current line
+    vector<Employee> matches;   // results of the current range or name query
+    size_t lineNumber = 0;
+
+    void split(string_view line) {
+        fields.clear();
+        size_t start = 0;
+        while (true) {
+            size_t tab = line.find('\t', start);
+            fields.push_back(line.substr(start, tab == string_view::npos ? string_view::npos : tab - start));
+            if (tab == string_view::npos) break;
+            start = tab + 1;
+        }
+    }
+
+    static bool parseInt(string_view s, int& value) {
+        auto result = from_chars(s.data(), s.data() + s.size(), value);
+        return result.ec == errc() && result.ptr == s.data() + s.size();
+    }
+
+    static bool parseField(string_view s, NameIndex::field& f) {
+        if (s == "first") f = NameIndex::firstName;
+        else if (s == "last") f = NameIndex::lastName;
+        else if (s == "title") f = NameIndex::jobTitle;
+        else return false;
+        return true;
+    }
+
+    void appendInt(long long value) {
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, result.ptr);
+    }
+
+    void writeRecord(const Employee& e) {
+        appendInt(e.salary);
+        out += '\t';
+        out.append(e.firstName.view());
+        out += '\t';
+        out.append(e.lastName.view());
+        out += '\t';
+        out.append(e.jobTitle.view());
+        out += '\n';
+    }
+
+    void writeFound(size_t n) {
+        out.append("found\t");
+        appendInt((long long)n);
+        out += '\n';
+    }
+
+    void error(const char* reason) {
+        out.append("error\t");
+        appendInt((long long)lineNumber);
+        out += '\t';
+        out.append(reason);
+        out += '\n';
+    }
+
+    // Fields 1 to 4 as an employee; false if the salary is not a number
+    bool parseEmployee(Employee& e) {
+        int salary;
+        if (fields.size() != 5 || !parseInt(fields[1], salary)) return false;
+        e = Employee(fields[2], fields[3], fields[4], salary);
+        return true;
+    }
+
+    void execute(string_view line) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty() || line.front() == '#') return;
+        split(line);
+        string_view command = fields[0];
+        Employee e;
+        int min, max;
+        if (command == "add") {
+            if (!parseEmployee(e)) return error("usage: add <salary> <first> <last> <title>");
+            if (log != nullptr) log->append(WriteAheadLog::logInsert, e);
+            employees->insert(std::move(e));
+            out.append("ok\n");
+        }
+        else if (command == "delete") {
+            if (!parseEmployee(e)) return error("usage: delete <salary> <first> <last> <title>");
+            if (!employees->contains(e)) {
+                out.append("missing\n");
+                return;
+            }
+            if (log != nullptr) log->append(WriteAheadLog::logRemove, e);
+            employees->remove(e);
+            out.append("ok\n");
+        }
+        else if (command == "find") {
+            if (fields.size() != 2 || !parseInt(fields[1], min)) return error("usage: find <salary>");
+            EmployeeSpan found = employees->findAll(min);
+            writeFound(found.size());
+            for (const Employee& f : found) writeRecord(f);
+        }
+        else if (command == "range") {
+            if (fields.size() != 3 || !parseInt(fields[1], min) || !parseInt(fields[2], max)) {
+                return error("usage: range <min> <max>");
+            }
+            matches.clear();
+            employees->copyInRange(min, max, back_inserter(matches));
+            writeFound(matches.size());
+            for (const Employee& f : matches) writeRecord(f);
+        }
+        else if (command == "count") {
+            if (fields.size() != 3 || !parseInt(fields[1], min) || !parseInt(fields[2], max)) {
+                return error("usage: count <min> <max>");
+            }
+            out.append("count\t");
+            appendInt((long long)employees->countInRange(min, max));
+            out += '\n';
+        }
+        else if (command == "payroll") {
+            if (fields.size() != 3 || !parseInt(fields[1], min) || !parseInt(fields[2], max)) {
+                return error("usage: payroll <min> <max>");
+            }
+            SalaryStats stats = employees->summarize(min, max);
+            out.append("payroll\t");
+            appendInt((long long)stats.count);
+            out += '\t';
+            appendInt(stats.total);
+            out += '\t';
+            appendInt(stats.lowest);
+            out += '\t';
+            appendInt(stats.highest);
+            out += '\n';
+        }
+        else if (command == "percentile") {
+            if (fields.size() != 2 || !parseInt(fields[1], min) || min < 0 || min > 100) {
+                return error("usage: percentile <0 to 100>");
+            }
+            if (employees->size() == 0) {
+                out.append("missing\n");
+                return;
+            }
+            out.append("salary\t");
+            appendInt(employees->percentile(min));
+            out += '\n';
+        }
+        else if (command == "name" || command == "prefix") {
+            NameIndex::field f;
+            if (fields.size() != 3 || !parseField(fields[1], f)) {
+                return error(command == "name" ? "usage: name <first|last|title> <name>" : "usage: prefix <first|last|title> <prefix>");
+            }
+            matches = command == "name" ? employees->findByName(f, fields[2]) : employees->findByPrefix(f, fields[2]);
+            writeFound(matches.size());
+            for (const Employee& m : matches) writeRecord(m);
+        }
+        else {
+            error("unknown command");
+        }
+    }
+
+public:
+    static constexpr size_t batchSize = 4096;   // commands per write
+
+    BatchUI(EmployeeRBT* tree, WriteAheadLog* log = nullptr) : employees(tree), log(log) {}
+
+    void run(istream& in, ostream& os) {
+        string line;
+        bool more = true;
+        while (more) {
+            out.clear();
+            for (size_t i = 0; i < batchSize; i++) {
+                if (!getline(in, line)) {
+                    more = false;
+                    break;
+                }
+                lineNumber++;
+                execute(line);
+            }
+            if (log != nullptr) {
+                // One fsync acknowledges the whole batch
+                log->waitDurable(log->lastSequence());
+                log->compactIfDue(employees->begin(), employees->end());
+            }
+            os.write(out.data(), (streamsize)out.size());
+        }
+        os.flush();
     }
 };
 
@@ -618,14 +4038,854 @@ static void initializeDummyData(EmployeeRBT& bst) {
     uniform_int_distribution<int> salaryDist(30'000, 200'000);
 
     for (int i = 0; i < 10000; i++) {
-        Employee e(randStr(8), randStr(8), randStr(8), salaryDist(gen));
-        bst.insert(e);
+        bst.emplace(randStr(8), randStr(8), randStr(8), salaryDist(gen));
+    }
+}
+
+/* Reproducible benchmarks for this engine. Workloads are generated from
+fixed seeds, so Employee_Info_BST and Employee_Info_RB_Tree time exactly
+the same operations on exactly the same data and their reports can be
+compared row by row. Peak RSS is the high-water mark of the whole
+process, so run one size per process when comparing memory. */
+class Benchmark {
+public:
+    enum distribution { uniform, sorted, reverseSorted, duplicates };
+
+    static const char* name(distribution d) {
+        switch (d) {
+        case sorted: return "sorted";
+        case reverseSorted: return "reverse";
+        case duplicates: return "duplicates";
+        default: return "uniform";
+        }
+    }
+
+    /* n employees with salaries in [30000, 200000] drawn from d. The
+    duplicates distribution only uses 100 distinct salaries. Names come
+    from fixed pools so they repeat the way they do in a real roster. */
+    static vector<Employee> workload(size_t n, distribution d, unsigned seed = 42) {
+        mt19937 gen(seed);
+        vector<InternedString> firstNames = namePool(gen, 2'000);
+        vector<InternedString> lastNames = namePool(gen, 20'000);
+        vector<InternedString> titles = namePool(gen, 300);
+        uniform_int_distribution<int> salaryDist(30'000, 200'000);
+        uniform_int_distribution<int> bandDist(0, 99);
+
+        vector<Employee> roster;
+        roster.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            int salary = (d == duplicates) ? 30'000 + bandDist(gen) * 1'700 : salaryDist(gen);
+            roster.emplace_back(firstNames[gen() % firstNames.size()], lastNames[gen() % lastNames.size()],
+                titles[gen() % titles.size()], salary);
+        }
+        if (d == sorted) stable_sort(roster.begin(), roster.end());
+        if (d == reverseSorted) stable_sort(roster.begin(), roster.end(), greater<Employee>());
+        return roster;
+    }
+
+    // Largest resident set size the process has reached, in bytes
+    static size_t peakRss() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+        return counters.PeakWorkingSetSize;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+        return (size_t)usage.ru_maxrss;
+#else
+        return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+    }
+
+    /* Runs insert, find, findAll, range, remove and teardown for every size
+    and distribution and prints one row per operation. A case whose inserts
+    take longer than budgetSeconds (the unbalanced BST on sorted input) is
+    cut short and reported as such instead of running for hours. */
+    static void suite(const vector<size_t>& sizes, double budgetSeconds) {
+        cout << left << setw(12) << "engine" << setw(12) << "workload" << right << setw(10) << "employees"
+            << "  " << left << setw(9) << "operation" << right << setw(10) << "ops" << setw(12) << "ns/op"
+            << setw(14) << "ops/s" << setw(12) << "peak RSS MB" << '\n';
+        for (size_t n : sizes) {
+            for (distribution d : { uniform, sorted, reverseSorted, duplicates }) {
+                runCase(n, d, budgetSeconds);
+            }
+        }
+        cout.flush();
+    }
+
+    /* Times bulkLoad of count unsorted employees, then findInRange and
+    printInRange (formatted, then thrown away) over all of them, on 1, 2,
+    4, ... threads of the shared WorkerPool, up to one per core. */
+    static void parallelScans(size_t count) {
+        vector<Employee> roster = workload(count, uniform);
+        WorkerPool& pool = WorkerPool::shared();
+        size_t cores = pool.size();
+        cout << "Bulk build and full-range scans of " << count << " employees\n";
+        cout << right << setw(10) << "threads" << setw(14) << "bulkLoad ms" << setw(14) << "find ms"
+            << setw(14) << "print ms" << setw(10) << "speedup" << '\n';
+        double single = 0;
+        for (size_t threads = 1;; threads = min(threads * 2, cores)) {
+            pool.limit(threads);
+            EmployeeRBT tree;
+            auto start = chrono::steady_clock::now();
+            tree.bulkLoad(roster);
+            double build = elapsedNs(start);
+            start = chrono::steady_clock::now();
+            vector<Employee> all = tree.findInRange(INT_MIN, INT_MAX);
+            double find = elapsedNs(start);
+            ostream discard(nullptr);
+            start = chrono::steady_clock::now();
+            tree.printInRange(INT_MIN, INT_MAX, discard);
+            double print = elapsedNs(start);
+            if (threads == 1) single = build + find + print;
+            cout << setw(10) << threads << fixed << setprecision(1) << setw(14) << build / 1e6 << setw(14) << find / 1e6
+                << setw(14) << print / 1e6 << setprecision(2) << setw(10) << single / (build + find + print) << '\n';
+            if (all.size() != count) cout << "  (found " << all.size() << " employees)\n";
+            if (threads == cores) break;
+        }
+        pool.limit(cores);
+        cout.flush();
+    }
+
+    /* Writes count employees to a CSV file at path and reads them back,
+    reporting the throughput of Csv::write, Csv::read and of bulkLoad on
+    what was read. */
+    static void csv(size_t count, const string& path) {
+        vector<Employee> roster = workload(count, uniform);
+        auto show = [](const char* label, size_t bytes, double ns) {
+            cout << "  " << setw(12) << left << label << right << fixed << setprecision(1) << setw(10) << ns / 1e6
+                << " ms" << setw(10) << (bytes / (1024.0 * 1024.0)) / (ns / 1e9) << " MB/s\n";
+        };
+
+        auto start = chrono::steady_clock::now();
+        Csv::write(path, roster.begin(), roster.end());
+        double writeNs = elapsedNs(start);
+        size_t bytes = 0;
+        {
+            ifstream probe(path, ios::binary | ios::ate);
+            bytes = size_t(probe.tellg());
+        }
+        cout << "CSV round trip of " << count << " employees, " << fixed << setprecision(1)
+            << bytes / (1024.0 * 1024.0) << " MB at " << path << '\n';
+        show("write", bytes, writeNs);
+
+        start = chrono::steady_clock::now();
+        vector<Employee> loaded = Csv::read(path);
+        show("read", bytes, elapsedNs(start));
+
+        EmployeeRBT tree;
+        start = chrono::steady_clock::now();
+        tree.bulkLoad(loaded);
+        show("bulkLoad", bytes, elapsedNs(start));
+        if (loaded != roster) cout << "  read back a different roster\n";
+        std::remove(path.c_str());
+    }
+
+    /* Runs 1, 2, 4, ... up to maxThreads reader threads doing findAll-style
+    lookups on a ConcurrentEmployeeRBT of count employees for a second each,
+    while one writer inserts and removes an employee every 100 microseconds,
+    and reports how lookup throughput scales with the number of readers. */
+    static void concurrentReads(size_t count, unsigned maxThreads) {
+        ConcurrentEmployeeRBT tree;
+        tree.bulkLoad(workload(count, uniform));
+        vector<Employee> edits = workload(10'000, uniform, 99);
+        vector<int> queries = probes(1'000'000);
+
+        cout << "Concurrent lookups over " << count << " employees, one writer\n";
+        cout << right << setw(10) << "readers" << setw(16) << "lookups/s" << setw(16) << "per reader"
+            << setw(10) << "speedup" << setw(12) << "writes/s" << '\n';
+        double single = 0;
+        for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+            atomic<bool> stop{ false };
+            vector<size_t> done(threads);
+            size_t hits = 0;
+            mutex hitsLock;
+            vector<thread> readers;
+            for (unsigned t = 0; t < threads; t++) {
+                readers.emplace_back([&, t] {
+                    size_t i = t * 7919, lookups = 0, found = 0;
+                    while (!stop.load(memory_order_relaxed)) {
+                        for (int k = 0; k < 256; k++) found += tree.count(queries[i++ % queries.size()]);
+                        lookups += 256;
+                    }
+                    done[t] = lookups;
+                    lock_guard<mutex> guard(hitsLock);
+                    hits += found;
+                });
+            }
+            size_t writes = 0;
+            thread writer([&] {
+                while (!stop.load(memory_order_relaxed)) {
+                    const Employee& e = edits[writes % edits.size()];
+                    tree.insert(e);
+                    tree.remove(e);
+                    writes += 2;
+                    this_thread::sleep_for(chrono::microseconds(100));
+                }
+            });
+            auto start = chrono::steady_clock::now();
+            this_thread::sleep_for(chrono::seconds(1));
+            stop = true;
+            for (thread& r : readers) r.join();
+            writer.join();
+            double seconds = elapsedNs(start) / 1e9;
+
+            size_t total = 0;
+            for (size_t d : done) total += d;
+            double rate = total / seconds;
+            if (threads == 1) single = rate;
+            cout << setw(10) << threads << fixed << setprecision(0) << setw(16) << rate << setw(16) << rate / threads
+                << setprecision(2) << setw(10) << rate / single << setprecision(0) << setw(12) << writes / seconds << '\n';
+            if (hits == 0) cout << "  (no lookups matched)\n";
+        }
+        cout.flush();
+    }
+
+    /* For each entry of threadCounts, splits count employees between that
+    many writer threads, which insert their share into one shared Tree at
+    the same time and then remove it again. Every ConcurrentEmployeeRBT
+    write takes its one lock exclusively, so that run is the baseline for
+    ShardedEmployeeRBT here and for the lock-free EmployeeSkipList in
+    Employee_Info_Skip_List. */
+    template<typename Tree>
+    static void concurrentWrites(const char* engine, size_t count, const vector<unsigned>& threadCounts) {
+        vector<Employee> roster = workload(count, uniform);
+        cout << "Concurrent writes of " << count << " employees into one " << engine << "\n";
+        cout << right << setw(10) << "writers" << setw(16) << "inserts/s" << setw(16) << "removes/s"
+            << setw(10) << "speedup" << '\n';
+        double single = 0;
+        for (unsigned threads : threadCounts) {
+            Tree tree;
+            auto run = [&](auto write) {
+                vector<thread> writers;
+                auto start = chrono::steady_clock::now();
+                for (unsigned t = 0; t < threads; t++) {
+                    writers.emplace_back([&, t] {
+                        for (size_t i = count * t / threads; i < count * (t + 1) / threads; i++) write(roster[i]);
+                    });
+                }
+                for (thread& w : writers) w.join();
+                return count / (elapsedNs(start) / 1e9);
+            };
+            auto stored = [&tree] {
+                size_t n = 0;
+                tree.forEachInRange(INT_MIN, INT_MAX, [&n](const Employee&) { n++; });
+                return n;
+            };
+
+            double inserts = run([&tree](const Employee& e) { tree.insert(e); });
+            size_t afterInserts = stored();
+            double removes = run([&tree](const Employee& e) { tree.remove(e); });
+            if (single == 0) single = inserts;
+            cout << setw(10) << threads << fixed << setprecision(0) << setw(16) << inserts << setw(16) << removes
+                << setprecision(2) << setw(10) << inserts / single << '\n';
+            if (afterInserts != count || stored() != 0) cout << "  (writes were lost)\n";
+        }
+        cout.flush();
+    }
+
+    /* Runs whole-roster payroll reports back to back on one thread while
+    another inserts and removes employees as fast as it can, for a second
+    against each engine. ConcurrentEmployeeRBT reports hold the read lock for
+    the whole scan; PersistentEmployeeRBT reports read a version and take no
+    lock. Shows how many writes got through and the longest one waited. */
+    static void snapshotReads(size_t count) {
+        vector<Employee> roster = workload(count, uniform);
+        vector<Employee> edits = workload(10'000, uniform, 99);
+
+        auto run = [&](const char* label, auto& tree, auto report) {
+            atomic<bool> stop{ false };
+            size_t reports = 0, writes = 0;
+            long long total = 0;
+            double worstNs = 0;
+            thread reader([&] {
+                while (!stop.load(memory_order_relaxed)) {
+                    total += report();
+                    reports++;
+                }
+            });
+            thread writer([&] {
+                while (!stop.load(memory_order_relaxed)) {
+                    const Employee& e = edits[writes % edits.size()];
+                    auto start = chrono::steady_clock::now();
+                    tree.insert(e);
+                    tree.remove(e);
+                    worstNs = max(worstNs, elapsedNs(start));
+                    writes += 2;
+                }
+            });
+            auto start = chrono::steady_clock::now();
+            this_thread::sleep_for(chrono::seconds(1));
+            stop = true;
+            reader.join();
+            writer.join();
+            double seconds = elapsedNs(start) / 1e9;
+            cout << "  " << left << setw(24) << label << right << fixed << setprecision(1) << setw(12) << reports / seconds
+                << setprecision(0) << setw(12) << writes / seconds << setprecision(1) << setw(16) << worstNs / 1e3 << '\n';
+            if (total == 0) cout << "  (no employees reported)\n";
+        };
+
+        cout << "Whole-roster reports over " << count << " employees against one writer\n";
+        cout << "  " << left << setw(24) << "engine" << right << setw(12) << "reports/s" << setw(12) << "writes/s"
+            << setw(16) << "worst write us" << '\n';
+        {
+            ConcurrentEmployeeRBT tree;
+            tree.bulkLoad(roster);
+            run("ConcurrentEmployeeRBT", tree, [&tree] {
+                long long sum = 0;
+                tree.forEachInRange(INT_MIN, INT_MAX, [&sum](const Employee& e) { sum += e.salary; });
+                return sum;
+            });
+        }
+        {
+            PersistentEmployeeRBT tree;
+            tree.bulkLoad(roster);
+            run("PersistentEmployeeRBT", tree, [&tree] {
+                long long sum = 0;
+                PersistentEmployeeRBT::version v = tree.current();
+                v.forEachInRange(INT_MIN, INT_MAX, [&sum](const Employee& e) { sum += e.salary; });
+                return sum;
+            });
+        }
+        cout.flush();
+    }
+
+    /* Times random salary lookups against EmployeeRBT::find and against a SalaryIndex
+    of the same employees under every KeySearch kernel this CPU supports. */
+    static void keySearch(size_t count) {
+        vector<Employee> roster = workload(count, uniform);
+        EmployeeRBT tree;
+        tree.bulkLoad(roster);
+        SalaryIndex index(tree.begin(), tree.end());
+        vector<int> queries = probes(1'000'000);
+
+        auto time = [&](const string& label, auto lookup) {
+            size_t hits = 0;
+            auto start = chrono::steady_clock::now();
+            for (int q : queries) hits += (lookup(q) != nullptr);
+            double ns = elapsedNs(start);
+            cout << "  " << setw(30) << left << label << right << fixed << setprecision(1)
+                << ns / queries.size() << " ns/lookup (" << hits << " hits)\n";
+        };
+
+        cout << "Salary lookups over " << count << " employees\n";
+        time("EmployeeRBT::find", [&](int q) { return tree.find(q); });
+        KeySearch::kernel best = KeySearch::detect();
+        for (int k = KeySearch::scalar; k <= best; k++) {
+            KeySearch::use(KeySearch::kernel(k));
+            time(string("SalaryIndex::find (") + KeySearch::name(KeySearch::kernel(k)) + ")",
+                [&](int q) { return index.find(q); });
+        }
+        KeySearch::use(best);
+    }
+
+    /* Times batch lookups, inserts and removes of batch employees against
+    the same number of single calls, on two copies of a tree of count. */
+    static void batchOperations(size_t count, size_t batch) {
+        vector<Employee> roster = workload(count, uniform);
+        vector<Employee> extra = workload(batch, uniform, 9);
+        vector<int> lookups = probes(batch);
+        EmployeeRBT single, batched;
+        single.bulkLoad(roster);
+        batched.bulkLoad(roster);
+
+        auto time = [&](const char* operation, auto one, auto all) {
+            auto start = chrono::steady_clock::now();
+            size_t sum = one();
+            double singleNs = elapsedNs(start);
+            start = chrono::steady_clock::now();
+            size_t batchSum = all();
+            double batchNs = elapsedNs(start);
+            cout << "  " << setw(8) << left << operation << right << fixed << setprecision(1)
+                << setw(14) << singleNs / batch << setw(14) << batchNs / batch
+                << (sum == batchSum ? "" : "  (results differ)") << '\n';
+        };
+
+        cout << "Batches of " << batch << " over " << count << " employees, ns/op\n";
+        cout << "  " << setw(8) << left << "" << right << setw(14) << "one by one" << setw(14) << "batched" << '\n';
+        time("find", [&] {
+            size_t n = 0;
+            for (int q : lookups) n += single.findAll(q).size();
+            return n;
+        }, [&] {
+            size_t n = 0;
+            for (const EmployeeSpan& found : batched.findBatch(lookups)) n += found.size();
+            return n;
+        });
+        time("insert", [&] {
+            for (const Employee& e : extra) single.insert(e);
+            return extra.size();
+        }, [&] {
+            batched.insertBatch(extra);
+            return extra.size();
+        });
+        time("remove", [&] {
+            for (const Employee& e : extra) single.remove(e);
+            return extra.size();
+        }, [&] {
+            return batched.removeBatch(extra);
+        });
+        cout.flush();
+    }
+
+    /* Times counting and totalling the employees in salary bands and
+    finding the median by walking the tree, against countInRange,
+    summarize and percentile. */
+    static void orderStatistics(size_t count) {
+        vector<Employee> roster = workload(count, uniform);
+        EmployeeRBT tree;
+        tree.bulkLoad(roster);
+        vector<int> lookups = probes(10'000);
+
+        auto time = [](const string& label, size_t ops, auto query) {
+            size_t sum = 0;
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < ops; i++) sum += query(i);
+            double ns = elapsedNs(start);
+            cout << "  " << setw(38) << left << label << right << fixed << setprecision(1)
+                << setw(12) << ns / ops << " ns/query (checksum " << sum << ")\n";
+        };
+
+        cout << "Order statistics and payroll over " << count << " employees\n";
+        time("count a 10000 band, forEachInRange", lookups.size(), [&](size_t i) {
+            size_t n = 0;
+            tree.forEachInRange(lookups[i], lookups[i] + 9'999, [&n](const Employee&) { n++; });
+            return n;
+        });
+        time("count a 10000 band, countInRange", lookups.size(), [&](size_t i) {
+            return tree.countInRange(lookups[i], lookups[i] + 9'999);
+        });
+        time("payroll of a 10000 band, forEachInRange", lookups.size(), [&](size_t i) {
+            long long total = 0;
+            tree.forEachInRange(lookups[i], lookups[i] + 9'999, [&total](const Employee& e) { total += e.salary; });
+            return (size_t)total;
+        });
+        time("payroll of a 10000 band, summarize", lookups.size(), [&](size_t i) {
+            return (size_t)tree.summarize(lookups[i], lookups[i] + 9'999).total;
+        });
+        time("median, iterating", 10, [&](size_t) {
+            return (size_t)next(tree.begin(), (tree.size() + 1) / 2 - 1)->salary;
+        });
+        time("median, percentile(50)", lookups.size(), [&](size_t) {
+            return (size_t)tree.percentile(50);
+        });
+        cout.flush();
+    }
+
+    /* Times lookups by last name and by job title prefix over count
+    employees, first by scanning the tree and then through a NameIndex,
+    and what keeping all three indexes up to date adds to each insert and
+    remove. */
+    static void nameLookups(size_t count) {
+        vector<Employee> roster = workload(count, uniform);
+        const NameIndex::field allFields[] = { NameIndex::firstName, NameIndex::lastName, NameIndex::jobTitle };
+        EmployeeRBT tree;
+        tree.bulkLoad(roster);
+        mt19937 gen(7);
+        vector<string> names, prefixes;
+        for (int i = 0; i < 1000; i++) {
+            const Employee& e = roster[gen() % roster.size()];
+            names.emplace_back(e.lastName.view());
+            prefixes.emplace_back(e.jobTitle.view().substr(0, 2));
+        }
+
+        // Scans are timed over the first few queries only
+        auto time = [&](const string& label, const vector<string>& queries, size_t limit, auto lookup) {
+            size_t n = min(limit, queries.size()), found = 0;
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < n; i++) found += lookup(queries[i]).size();
+            double ns = elapsedNs(start);
+            cout << "  " << setw(32) << left << label << right << fixed << setprecision(1)
+                << ns / n / 1000 << " us/query (" << found / n << " matches each)\n";
+        };
+        auto byName = [&tree](const string& q) { return tree.findByName(NameIndex::lastName, q); };
+        auto byPrefix = [&tree](const string& q) { return tree.findByPrefix(NameIndex::jobTitle, q); };
+
+        cout << "Name lookups over " << count << " employees\n";
+        time("findByName(lastName), scan", names, 20, byName);
+        time("findByPrefix(jobTitle), scan", prefixes, 20, byPrefix);
+        auto start = chrono::steady_clock::now();
+        for (NameIndex::field f : allFields) tree.addIndex(f);
+        cout << "  " << setw(32) << left << "addIndex, all three fields" << right << fixed << setprecision(1)
+            << elapsedNs(start) / 1e6 << " ms\n";
+        time("findByName(lastName), indexed", names, names.size(), byName);
+        time("findByPrefix(jobTitle), indexed", prefixes, prefixes.size(), byPrefix);
+
+        // Fills a fresh tree, then empties it in random order; ns per insert and per remove
+        vector<size_t> order(roster.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        shuffle(order.begin(), order.end(), gen);
+        auto churn = [&](bool indexed) {
+            EmployeeRBT fresh;
+            if (indexed) for (NameIndex::field f : allFields) fresh.addIndex(f);
+            auto start = chrono::steady_clock::now();
+            for (const Employee& e : roster) fresh.insert(e);
+            double insert = elapsedNs(start) / roster.size();
+            start = chrono::steady_clock::now();
+            for (size_t i : order) fresh.remove(roster[i]);
+            return make_pair(insert, elapsedNs(start) / roster.size());
+        };
+        pair<double, double> plain = churn(false), indexed = churn(true);
+        cout << "  " << setw(32) << left << "insert, no indexes" << right << plain.first << " ns/op\n";
+        cout << "  " << setw(32) << left << "insert, all three indexes" << right << indexed.first << " ns/op\n";
+        cout << "  " << setw(32) << left << "remove, no indexes" << right << plain.second << " ns/op\n";
+        cout << "  " << setw(32) << left << "remove, all three indexes" << right << indexed.second << " ns/op\n";
+        cout.flush();
+    }
+
+    /* Times removing specific employees from the duplicates workload, where
+    thousands of employees share each salary, with ties kept in insertion
+    order and in key order. */
+    static void tieRemovals(size_t count) {
+        vector<Employee> roster = workload(count, duplicates);
+        vector<size_t> victims(count);
+        for (size_t i = 0; i < count; i++) victims[i] = i;
+        shuffle(victims.begin(), victims.end(), mt19937(11));
+        victims.resize(min<size_t>(count / 2, 100'000));
+
+        cout << "Removing " << victims.size() << " of " << count << " employees on 100 salaries\n";
+        for (EmployeeRBT::tieOrder order : { EmployeeRBT::insertionOrder, EmployeeRBT::keyOrder }) {
+            EmployeeRBT tree;
+            tree.orderTies(order);
+            auto start = chrono::steady_clock::now();
+            tree.bulkLoad(roster);
+            double load = elapsedNs(start);
+            start = chrono::steady_clock::now();
+            for (size_t i : victims) tree.remove(roster[i]);
+            double remove = elapsedNs(start);
+            cout << "  " << setw(16) << left << (order == EmployeeRBT::keyOrder ? "keyOrder" : "insertionOrder") << right
+                << fixed << setprecision(1) << setw(10) << load / 1e6 << " ms bulkLoad"
+                << setw(12) << remove / victims.size() << " ns/remove\n";
+        }
+        cout.flush();
+    }
+
+    /* Times count inserts into a tree with no log, into one whose changes go
+    through a WriteAheadLog at path and are acknowledged once per BatchUI
+    batch, and, over a shorter run, with an fsync for every insert. */
+    static void durability(size_t count, const string& path) {
+        vector<Employee> roster = workload(count, uniform);
+        auto time = [&](const string& label, size_t ops, size_t ackEvery) {
+            std::remove(path.c_str());
+            std::remove((path + ".wal").c_str());
+            EmployeeRBT tree;
+            unique_ptr<WriteAheadLog> log;
+            if (ackEvery > 0) {
+                log = make_unique<WriteAheadLog>(path);
+                log->open(0, [](WriteAheadLog::operation, const Employee&) {});
+            }
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < ops; i++) {
+                uint64_t sequence = log ? log->append(WriteAheadLog::logInsert, roster[i]) : 0;
+                tree.insert(roster[i]);
+                if (log && (i + 1) % ackEvery == 0) log->waitDurable(sequence);
+            }
+            if (log) log->waitDurable(log->lastSequence());
+            double perOp = elapsedNs(start) / ops;
+            cout << "  " << setw(34) << left << label << right << setw(10) << ops << fixed << setprecision(1)
+                << setw(12) << perOp << " ns/insert" << setprecision(0) << setw(12) << 1e9 / perOp << " inserts/s\n";
+            return perOp;
+        };
+
+        cout << "Inserts with and without the write-ahead log at " << path << '\n';
+        double memory = time("in memory", count, 0);
+        double grouped = time("logged, acknowledged per batch", count, BatchUI::batchSize);
+        time("logged, fsync per insert", min<size_t>(count, 2'000), 1);
+        cout << "  group commit costs " << fixed << setprecision(2) << grouped / memory << "x the in-memory time\n";
+        std::remove(path.c_str());
+        std::remove((path + ".wal").c_str());
+    }
+
+private:
+    static vector<InternedString> namePool(mt19937& gen, size_t count) {
+        const string CHARACTERS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+        vector<InternedString> pool;
+        pool.reserve(count);
+        string name(8, ' ');
+        for (size_t i = 0; i < count; i++) {
+            for (char& c : name) c = CHARACTERS[gen() % CHARACTERS.size()];
+            pool.emplace_back(name);
+        }
+        return pool;
+    }
+
+    // Salaries to look up, the same for every engine and workload
+    static vector<int> probes(size_t count) {
+        mt19937 gen(7);
+        uniform_int_distribution<int> salaryDist(30'000, 200'000);
+        vector<int> out(count);
+        for (int& p : out) p = salaryDist(gen);
+        return out;
+    }
+
+    static double elapsedNs(chrono::steady_clock::time_point start) {
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    }
+
+    static void report(distribution d, size_t n, const char* operation, size_t ops, double ns) {
+        double perOp = ops == 0 ? 0 : ns / ops;
+        cout << left << setw(12) << "EmployeeRBT" << setw(12) << name(d) << right << setw(10) << n
+            << "  " << left << setw(9) << operation << right << setw(10) << ops
+            << fixed << setprecision(1) << setw(12) << perOp
+            << setprecision(0) << setw(14) << (perOp == 0 ? 0 : 1e9 / perOp)
+            << setprecision(1) << setw(12) << peakRss() / (1024.0 * 1024.0) << '\n';
+    }
+
+    static void runCase(size_t n, distribution d, double budgetSeconds) {
+        vector<Employee> roster = workload(n, d);
+        vector<int> lookups = probes(min<size_t>(n, 1'000'000));
+        unique_ptr<EmployeeRBT> tree = make_unique<EmployeeRBT>();
+
+        auto start = chrono::steady_clock::now();
+        size_t inserted = 0;
+        for (const Employee& e : roster) {
+            tree->insert(e);
+            if (++inserted % 1024 == 0 && elapsedNs(start) > budgetSeconds * 1e9) break;
+        }
+        report(d, n, "insert", inserted, elapsedNs(start));
+        if (inserted < n) {
+            cout << "  insert exceeded the " << budgetSeconds << "s budget; skipping the rest of this case\n";
+            cout.flush();
+            return;
+        }
+
+        size_t hits = 0;
+        start = chrono::steady_clock::now();
+        for (int q : lookups) hits += (tree->find(q) != nullptr);
+        report(d, n, "find", lookups.size(), elapsedNs(start));
+
+        start = chrono::steady_clock::now();
+        for (int q : lookups) hits += tree->findAll(q).size();
+        report(d, n, "findAll", lookups.size(), elapsedNs(start));
+
+        // Narrow salary bands of 1000, a tenth as many as the point lookups.
+        // Every match is read so the visit cannot be optimized away.
+        size_t bands = max<size_t>(1, lookups.size() / 10);
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < bands; i++) {
+            tree->forEachInRange(lookups[i], lookups[i] + 999, [&hits](const Employee& e) { hits += e.salary; });
+        }
+        report(d, n, "range", bands, elapsedNs(start));
+
+        vector<size_t> victims(n);
+        for (size_t i = 0; i < n; i++) victims[i] = i;
+        shuffle(victims.begin(), victims.end(), mt19937(11));
+        victims.resize(min<size_t>(n / 2, 100'000));    // leave the rest for teardown
+        start = chrono::steady_clock::now();
+        for (size_t i : victims) tree->remove(roster[i]);
+        report(d, n, "remove", victims.size(), elapsedNs(start));
+
+        start = chrono::steady_clock::now();
+        tree.reset();
+        report(d, n, "teardown", n - victims.size(), elapsedNs(start));
+        if (hits == 0) cout << "  (no lookups matched)\n";
+        cout.flush();
+    }
+};
+
+// Replaces the contents of rbt with the snapshot at path plus the changes
+// logged since, and starts logging unless readOnly, which leaves the log
+// file untouched. Returns false if there was nothing yet.
+static bool loadSnapshot(EmployeeRBT& rbt, const string& path, WriteAheadLog& log, bool readOnly = false) {
+    Snapshot snapshot;
+    size_t replayed = 0;
+    try {
+        bool found = snapshot.open(path);
+        if (found) rbt.bulkLoad(snapshot.employees());
+        auto apply = [&rbt](WriteAheadLog::operation op, const Employee& e) {
+            if (op == WriteAheadLog::logInsert) rbt.insert(e);
+            else rbt.remove(e);
+        };
+        replayed = readOnly ? log.replay(snapshot.logSequence(), apply) : log.open(snapshot.logSequence(), apply);
+        if (!found && replayed == 0) return false;
+    }
+    catch (const runtime_error& e) {
+        cerr << e.what() << endl;
+        exit(1);                        // refuse to run, and later overwrite, a file we cannot read
+    }
+    cerr << "Loaded " << snapshot.size() << " employees from " << path << " and replayed "
+        << replayed << " logged changes" << endl;
+    return true;
+}
+
+// Adds every employee in the CSV file at path to rbt.
+static void importCsv(EmployeeRBT& rbt, const string& path) {
+    try {
+        auto start = chrono::steady_clock::now();
+        vector<Employee> roster = Csv::read(path);
+        rbt.bulkLoad(roster);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cerr << "Imported " << roster.size() << " employees from " << path << " in " << seconds << " s" << endl;
+    }
+    catch (const runtime_error& e) {
+        cerr << e.what() << endl;
+        exit(1);
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    vector<string> args(argv + 1, argv + argc);
+    string csvPath;                     // --csv <file> [mode...]: add the roster in a CSV file at start
+    string snapshotPath;                // --snapshot <file> [mode...]: load at start, log changes, save at exit
+    while (args.size() >= 2 && (args[0] == "--snapshot" || args[0] == "--csv")) {
+        (args[0] == "--snapshot" ? snapshotPath : csvPath) = args[1];
+        args.erase(args.begin(), args.begin() + 2);
+    }
+    string mode = args.empty() ? "" : args[0];
+    if (mode == "--bench") {            // --bench [budget seconds] [employees...]
+        double budget = args.size() > 1 ? stod(args[1]) : 30;
+        vector<size_t> sizes;
+        for (size_t i = 2; i < args.size(); i++) sizes.push_back(stoul(args[i]));
+        if (sizes.empty()) sizes = { 10'000, 1'000'000, 10'000'000 };
+        Benchmark::suite(sizes, budget);
+        return 0;
+    }
+    if (mode == "--bench-parallel") {   // --bench-parallel [employees]
+        Benchmark::parallelScans(args.size() > 1 ? stoul(args[1]) : 1'000'000);
+        return 0;
+    }
+    if (mode == "--bench-search") {     // --bench-search [employees]
+        Benchmark::keySearch(args.size() > 1 ? stoul(args[1]) : 1'000'000);
+        return 0;
+    }
+    if (mode == "--bench-stats") {      // --bench-stats [employees]
+        Benchmark::orderStatistics(args.size() > 1 ? stoul(args[1]) : 1'000'000);
+        return 0;
+    }
+    if (mode == "--bench-batch") {      // --bench-batch [employees] [batch size]
+        Benchmark::batchOperations(args.size() > 1 ? stoul(args[1]) : 1'000'000, args.size() > 2 ? stoul(args[2]) : 50'000);
+        return 0;
+    }
+    if (mode == "--bench-names") {      // --bench-names [employees]
+        Benchmark::nameLookups(args.size() > 1 ? stoul(args[1]) : 1'000'000);
+        return 0;
+    }
+    if (mode == "--bench-ties") {       // --bench-ties [employees]
+        Benchmark::tieRemovals(args.size() > 1 ? stoul(args[1]) : 1'000'000);
+        return 0;
+    }
+    if (mode == "--bench-concurrent") { // --bench-concurrent [employees] [max reader threads]
+        unsigned cores = max(1u, thread::hardware_concurrency());
+        Benchmark::concurrentReads(args.size() > 1 ? stoul(args[1]) : 1'000'000,
+            args.size() > 2 ? unsigned(stoul(args[2])) : cores);
+        return 0;
+    }
+    if (mode == "--bench-writes") {     // --bench-writes [employees] [writer threads...]
+        vector<unsigned> threads;
+        for (size_t i = 2; i < args.size(); i++) threads.push_back(unsigned(stoul(args[i])));
+        if (threads.empty()) threads = { 1, 4, 16 };
+        size_t count = args.size() > 1 ? stoul(args[1]) : 1'000'000;
+        Benchmark::concurrentWrites<ConcurrentEmployeeRBT>("ConcurrentEmployeeRBT", count, threads);
+        Benchmark::concurrentWrites<ShardedEmployeeRBT>("ShardedEmployeeRBT", count, threads);
+        return 0;
+    }
+    if (mode == "--bench-mvcc") {       // --bench-mvcc [employees]
+        Benchmark::snapshotReads(args.size() > 1 ? stoul(args[1]) : 1'000'000);
+        return 0;
+    }
+    if (mode == "--bench-wal") {        // --bench-wal [employees] [log file]
+        Benchmark::durability(args.size() > 1 ? stoul(args[1]) : 1'000'000, args.size() > 2 ? args[2] : "bench.snap");
+        return 0;
+    }
+    if (mode == "--bench-csv") {        // --bench-csv [employees] [file]
+        Benchmark::csv(args.size() > 1 ? stoul(args[1]) : 1'000'000, args.size() > 2 ? args[2] : "bench.csv");
+        return 0;
+    }
+    if (mode == "--snapshot-query") {   // --snapshot-query <file> <min> <max>, straight from the mapping
+        if (args.size() < 4) {
+            cerr << "Usage: --snapshot-query <file> <min salary> <max salary>" << endl;
+            return 1;
+        }
+        Snapshot snapshot;
+        try {
+            if (!snapshot.open(args[1])) {
+                cerr << "Could not open " << args[1] << endl;
+                return 1;
+            }
+        }
+        catch (const runtime_error& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        ios::sync_with_stdio(false);
+        snapshot.printInRange(stoi(args[2]), stoi(args[3]));
+        return 0;
+    }
+    if (mode == "--export-csv") {       // --export-csv <file>: the roster from --snapshot and --csv, in salary order
+        if (args.size() < 2) {
+            cerr << "Usage: --export-csv <file>" << endl;
+            return 1;
+        }
+        EmployeeRBT rbt;
+        if (!snapshotPath.empty()) {
+            WriteAheadLog log(snapshotPath);
+            loadSnapshot(rbt, snapshotPath, log, true);
+        }
+        if (!csvPath.empty()) importCsv(rbt, csvPath);
+        try {
+            size_t rows = Csv::write(args[1], rbt.begin(), rbt.end());
+            cerr << "Exported " << rows << " employees to " << args[1] << endl;
+        }
+        catch (const runtime_error& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (mode == "--batch") {            // --batch [command file], stdin if omitted or -
+        ios::sync_with_stdio(false);
+        cin.tie(nullptr);
+        EmployeeRBT rbt;
+        unique_ptr<WriteAheadLog> log;
+        if (!snapshotPath.empty()) {
+            log = make_unique<WriteAheadLog>(snapshotPath);
+            loadSnapshot(rbt, snapshotPath, *log);
+        }
+        if (!csvPath.empty()) {
+            importCsv(rbt, csvPath);
+            if (log) log->compact(rbt.begin(), rbt.end());
+        }
+        rbt.orderTies(EmployeeRBT::keyOrder);
+        for (NameIndex::field f : { NameIndex::firstName, NameIndex::lastName, NameIndex::jobTitle }) rbt.addIndex(f);
+        BatchUI batch(&rbt, log.get());
+        string path = args.size() > 1 ? args[1] : "-";
+        if (path == "-") {
+            batch.run(cin, cout);
+        }
+        else {
+            ifstream commands(path);
+            if (!commands) {
+                cerr << "Could not open " << path << endl;
+                return 1;
+            }
+            batch.run(commands, cout);
+        }
+        if (log) log->compact(rbt.begin(), rbt.end());
+        return 0;
+    }
     EmployeeRBT rbt;
-    UI ui = UI(&rbt);
+    unique_ptr<WriteAheadLog> log;
+    if (!snapshotPath.empty()) log = make_unique<WriteAheadLog>(snapshotPath);
+    UI ui = UI(&rbt, log.get());
+    bool loaded = log && loadSnapshot(rbt, snapshotPath, *log);
+    if (!csvPath.empty()) {
+        importCsv(rbt, csvPath);
+        if (log) log->compact(rbt.begin(), rbt.end());
+        loaded = true;
+    }
+    if (loaded) {
+        cout << "Welcome back to the employee \"Database\"" << endl;
+        while (ui.mainMenu()) {}
+        return 0;
+    }
+    if (log) {                          // a snapshot that does not exist yet starts an empty session
+        cout << "Welcome to the employee \"Database\"" << endl;
+        while (ui.mainMenu()) {}
+        return 0;
+    }
     cout << "~~~ Inserting Evan, Thor, and Jonah ~~~" << endl;
     rbt.insert(Employee("evan", "whitmer", "frontend developer", 199999));
     rbt.insert(Employee("jonah", "ebent", "retired", 200000));
@@ -644,6 +4904,6 @@ int main() {
     cout << endl;
     initializeDummyData(rbt);
     cout << "Welcome to the employee \"Database\"" << endl;
-    while (true) ui.mainMenu();
+    while (ui.mainMenu()) {}
     return 0;
 }
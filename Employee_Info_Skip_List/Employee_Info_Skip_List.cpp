@@ -0,0 +1,1105 @@
+/*
+Names:  Jonah Ebent and Evan Whitmer
+Class:  CSC-344-A   Algorithms and Complexity
+
+Description:
+A third engine for the employee "database" of Employee_Info_BST and
+Employee_Info_RB_Tree: the same employees, menu, batch commands and
+benchmarks, kept in a lock-free skip list ordered by salary instead of a
+search tree, so many threads can add and delete employees at once without
+a global lock.
+
+--bench runs the same workloads as the two trees, and --bench-writes the
+same write-scaling runs as Employee_Info_RB_Tree, so the reports can be
+compared row by row.
+
+Skip List Properties
+- Levels: Every node is on the bottom level, and on each level above with probability 1/2.
+- Order: Every level is sorted by salary, then by last name, first name and job title, then by insertion sequence.
+- Search: Expected O(log n) steps, starting on the top level and dropping down a level
+  whenever the next node is past the key.
+*/
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+/* Interns strings into one table shared by the whole program, so equal
+strings are stored once and referred to by a 32-bit id. The characters
+live back to back in large blocks instead of one heap block per string.
+Ids are never reclaimed; the table only grows. */
+class StringPool {
+    static constexpr size_t blockSize = 1 << 20;
+    static constexpr size_t chunkSize = 1 << 16;  // ids per chunk of the id table
+
+    vector<unique_ptr<char[]>> blocks;
+    size_t blockUsed = 0;
+    // id -> characters. The chunk list is reserved up front and chunks never
+    // move, so view() can read any id it was handed without taking the lock.
+    vector<unique_ptr<string_view[]>> chunks;
+    uint32_t count = 0;
+    size_t bytes = 0;
+    unordered_map<string_view, uint32_t> ids;
+    mutex lock;
+
+    StringPool() {
+        chunks.reserve((size_t(UINT32_MAX) + 1) / chunkSize);
+        intern("");     // id 0 is the empty string
+    }
+
+    // Copies s into the character blocks and returns the stored copy.
+    string_view store(string_view s) {
+        if (blocks.empty() || s.size() > blockSize - blockUsed) {
+            blocks.emplace_back(new char[max(blockSize, s.size())]);
+            blockUsed = 0;
+            bytes += max(blockSize, s.size());
+        }
+        char* p = blocks.back().get() + blockUsed;
+        copy(s.begin(), s.end(), p);
+        blockUsed += s.size();
+        return string_view(p, s.size());
+    }
+
+public:
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    static StringPool& shared() {
+        static StringPool pool;
+        return pool;
+    }
+
+    uint32_t intern(string_view s) {
+        lock_guard<mutex> guard(lock);
+        auto found = ids.find(s);
+        if (found != ids.end()) return found->second;
+        if (count % chunkSize == 0) chunks.emplace_back(new string_view[chunkSize]);
+        string_view stored = store(s);
+        chunks.back()[count % chunkSize] = stored;
+        ids.emplace(stored, count);
+        return count++;
+    }
+
+    string_view view(uint32_t id) const {
+        return chunks[id / chunkSize][id % chunkSize];
+    }
+
+    // Number of distinct strings interned so far
+    size_t size() const { return count; }
+
+    // Bytes held for characters, not counting the id table or hash index
+    size_t bytesReserved() const { return bytes; }
+};
+
+/* A 4-byte handle to a string in the shared StringPool. Equal strings
+always get the same id, so equality is a single integer compare. */
+class InternedString {
+    uint32_t index = 0;
+
+public:
+    InternedString() {}
+    InternedString(string_view s) : index(StringPool::shared().intern(s)) {}
+    InternedString(const string& s) : InternedString(string_view(s)) {}
+    InternedString(const char* s) : InternedString(string_view(s)) {}
+
+    uint32_t id() const { return index; }
+    string_view view() const { return StringPool::shared().view(index); }
+    string str() const { return string(view()); }
+    bool empty() const { return index == 0; }
+
+    bool operator==(const InternedString& other) const { return index == other.index; }
+    bool operator!=(const InternedString& other) const { return index != other.index; }
+
+    // Orders by the characters, not by the order strings were interned in
+    bool operator<(const InternedString& other) const { return view() < other.view(); }
+
+    friend ostream& operator<<(ostream& os, const InternedString& obj) {
+        return os << obj.view();
+    }
+};
+
+/* One employee: the salary plus three handles into the shared StringPool,
+16 bytes in all, with no heap blocks of its own. */
+struct Employee {
+    Employee() {};
+    Employee(InternedString firstName, InternedString lastName, InternedString jobTitle, int salary) :
+        salary(salary),
+        firstName(firstName),
+        lastName(lastName),
+        jobTitle(jobTitle) {}
+
+    int salary{};
+    InternedString firstName{};
+    InternedString lastName{};
+    InternedString jobTitle{};
+
+    bool operator<(const Employee& other) const {
+        return salary < other.salary;
+    }
+
+    bool operator<=(const Employee& other) const {
+        return salary <= other.salary;
+    }
+
+    bool operator>(const Employee& other) const {
+        return salary > other.salary;
+    }
+
+    bool operator>=(const Employee& other) const {
+        return salary >= other.salary;
+    }
+
+    bool operator==(const Employee& other) const {
+        return salary == other.salary
+            && firstName == other.firstName
+            && lastName == other.lastName
+            && jobTitle == other.jobTitle;
+    }
+
+    bool operator!=(const Employee& other) const {
+        return !(*this == other);
+    }
+
+    friend ostream& operator<<(ostream& os, const Employee& obj) {
+        os << obj.firstName << " " << obj.lastName << ", " << obj.jobTitle << " ($" << obj.salary << ")";
+        return os;
+    }
+};
+
+/* A total order on employees: by salary, then by last name, first name
+and job title, comparing their characters. Unlike operator<, it only
+calls two employees equivalent when operator== calls them equal. */
+struct EmployeeKeyLess {
+    bool operator()(const Employee& a, const Employee& b) const {
+        if (a.salary != b.salary) return a.salary < b.salary;
+        if (a.lastName != b.lastName) return a.lastName < b.lastName;
+        if (a.firstName != b.firstName) return a.firstName < b.firstName;
+        return a.jobTitle < b.jobTitle;
+    }
+};
+
+/* A lock-free skip list of employees ordered by salary, for a roster that
+many threads edit at once. insert and remove take no lock: they link and
+unlink nodes with compare-and-swap on the next pointers (Harris' marked
+links, as in Herlihy and Shavit's lock-free skip list), so writers in
+different parts of the list never wait for each other and a thread that
+stalls mid-write cannot hold anyone else up.
+
+Every employee has a node of its own. Nodes are ordered by EmployeeKeyLess,
+then by a sequence number taken at insert, which makes every key unique
+and puts equal employees next to each other, so remove searches straight
+for its employee instead of scanning everyone on the same salary.
+Employees on one salary therefore come out in the same order as the
+trees' buckets under keyOrder, which --batch uses, not in insertion order. A remove marks the
+node's links from the top level down; the thread that marks the bottom
+link owns the removal, and any search that walks past a marked link
+unlinks the node on the way.
+
+Unlinked nodes are retired rather than freed, with the same epochs as
+PersistentEmployeeRBT in Employee_Info_RB_Tree: every operation pins the
+epoch it started in, in one of a fixed set of slots, and a retired node
+is freed once every pinned epoch is newer than the one it was retired in.
+Lookups copy employees out, since a node may be freed as soon as the call
+returns. */
+class EmployeeSkipList {
+    static constexpr int maxHeight = 32;
+
+    struct node {
+        node(const Employee& e, uint64_t sequence, int height) : employee(e), sequence(sequence), height(height) {}
+
+        Employee employee;
+        uint64_t sequence;          // insertion order, which breaks ties between equal employees
+        int height;
+        atomic<int> owners{ 2 };    // the inserting thread and the list; retired once both let go
+
+        // The node's height links follow it in the same allocation. The low
+        // bit of a link marks this node as removed at that level.
+        atomic<uintptr_t>* next() { return reinterpret_cast<atomic<uintptr_t>*>(this + 1); }
+    };
+
+    // One pinned epoch, or 0 when free, and the nodes retired by operations
+    // that ran in this slot. Only the operation holding the slot touches
+    // retired. Each slot has a cache line to itself.
+    struct alignas(64) threadSlot {
+        atomic<uint64_t> epoch{ 0 };
+        vector<pair<uint64_t, node*>> retired;  // oldest first
+    };
+
+    static constexpr size_t threadSlots = 128;  // operations that can run at once
+    static constexpr size_t reclaimBatch = 64;  // retired nodes a slot holds before it scans the others
+
+    node* head;
+    atomic<uint64_t> epoch{ 1 };
+    atomic<uint64_t> nextSequence{ 1 };
+    mutable threadSlot slots[threadSlots];
+
+    // Pins the current epoch for the length of one operation
+    class guard {
+        const EmployeeSkipList& list;
+
+    public:
+        threadSlot& slot;
+
+        guard(const EmployeeSkipList& list) : list(list), slot(list.enter()) {}
+        ~guard() { list.leave(slot); }
+    };
+
+    static node* pointer(uintptr_t link) { return reinterpret_cast<node*>(link & ~uintptr_t(1)); }
+    static bool marked(uintptr_t link) { return (link & 1) != 0; }
+
+    static node* create(const Employee& e, uint64_t sequence, int height) {
+        void* memory = ::operator new(sizeof(node) + height * sizeof(atomic<uintptr_t>));
+        node* n = new (memory) node(e, sequence, height);
+        for (int level = 0; level < height; level++) new (n->next() + level) atomic<uintptr_t>(0);
+        return n;
+    }
+
+    static void destroy(node* n) {
+        n->~node();
+        ::operator delete(n);
+    }
+
+    // 1 plus the number of leading heads in a run of coin flips
+    static int randomHeight() {
+        thread_local mt19937 gen(random_device{}());
+        uint32_t bits = gen();
+        int height = 1;
+        while (height < maxHeight && (bits & 1)) {
+            height++;
+            bits >>= 1;
+        }
+        return height;
+    }
+
+    // True if n comes before e inserted with the given sequence number
+    static bool before(const node* n, const Employee& e, uint64_t sequence) {
+        const Employee& x = n->employee;
+        if (x != e) return EmployeeKeyLess()(x, e);     // equal ids are equal names, so no characters to compare
+        return n->sequence < sequence;
+    }
+
+    threadSlot& enter() const {
+        size_t start = hash<thread::id>()(this_thread::get_id()) % threadSlots;
+        for (size_t i = start;; i = (i + 1) % threadSlots) {
+            uint64_t expected = 0;
+            if (slots[i].epoch.compare_exchange_strong(expected, epoch.load())) return slots[i];
+            if ((i + 1) % threadSlots == start) this_thread::yield();   // every slot is taken
+        }
+    }
+
+    // Frees what this slot has retired that no other operation can still
+    // reach, then unpins it. The operation leaving holds no nodes any more,
+    // so its own pin does not count.
+    void leave(threadSlot& slot) const {
+        if (slot.retired.size() >= reclaimBatch) {
+            uint64_t oldest = UINT64_MAX;
+            for (const threadSlot& s : slots) {
+                uint64_t pinned = s.epoch.load();
+                if (&s != &slot && pinned != 0) oldest = min(oldest, pinned);
+            }
+            size_t freed = 0;
+            while (freed < slot.retired.size() && slot.retired[freed].first <= oldest) destroy(slot.retired[freed++].second);
+            slot.retired.erase(slot.retired.begin(), slot.retired.begin() + freed);
+        }
+        slot.epoch.store(0);
+    }
+
+    // Drops one owner of n, and retires n when it was the last. By then it
+    // is unlinked at every level and nothing links it again.
+    void release(node* n, threadSlot& slot) {
+        if (n->owners.fetch_sub(1) != 1) return;
+        slot.retired.emplace_back(epoch.fetch_add(1) + 1, n);
+    }
+
+    /* One pass of search; false if a link changed under it and it must
+    start over from the top. */
+    bool trySearch(const Employee& e, uint64_t sequence, node** preds, node** succs) {
+        node* pred = head;
+        for (int level = maxHeight - 1; level >= 0; level--) {
+            node* curr = pointer(pred->next()[level].load());
+            while (curr != nullptr) {
+                uintptr_t succ = curr->next()[level].load();
+                if (marked(succ)) {
+                    uintptr_t expected = uintptr_t(curr);
+                    if (!pred->next()[level].compare_exchange_strong(expected, succ & ~uintptr_t(1))) return false;
+                    curr = pointer(succ);
+                }
+                else if (before(curr, e, sequence)) {
+                    pred = curr;
+                    curr = pointer(succ);
+                }
+                else {
+                    break;
+                }
+            }
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+        return true;
+    }
+
+    /* Fills preds and succs with the nodes either side of the key of e and
+    sequence on every level, unlinking any removed node it passes, and
+    returns the first node at or after that key on the bottom level. */
+    node* search(const Employee& e, uint64_t sequence, node** preds, node** succs) {
+        while (!trySearch(e, sequence, preds, succs)) {}
+        return succs[0];
+    }
+
+    // First node on the bottom level earning at least salary, removed or not.
+    // Reads only, so lookups never write to shared links.
+    node* lowerBound(int salary) const {
+        node* pred = head;
+        for (int level = maxHeight - 1; level >= 0; level--) {
+            node* curr = pointer(pred->next()[level].load());
+            while (curr != nullptr && curr->employee.salary < salary) {
+                pred = curr;
+                curr = pointer(curr->next()[level].load());
+            }
+        }
+        return pointer(pred->next()[0].load());
+    }
+
+public:
+    EmployeeSkipList() : head(create(Employee(), 0, maxHeight)) {}
+
+    EmployeeSkipList(const EmployeeSkipList&) = delete;
+    EmployeeSkipList& operator=(const EmployeeSkipList&) = delete;
+
+    // Only safe once no other thread is using the list
+    ~EmployeeSkipList() {
+        node* n = head;
+        while (n != nullptr) {
+            node* next = pointer(n->next()[0].load());
+            destroy(n);
+            n = next;
+        }
+        for (threadSlot& s : slots) {
+            for (auto& r : s.retired) destroy(r.second);
+        }
+    }
+
+    void insert(const Employee& e) {
+        guard g(*this);
+        int height = randomHeight();
+        node* n = create(e, nextSequence.fetch_add(1), height);
+        node* preds[maxHeight];
+        node* succs[maxHeight];
+        while (true) {
+            search(e, n->sequence, preds, succs);
+            for (int level = 0; level < height; level++) n->next()[level].store(uintptr_t(succs[level]), memory_order_relaxed);
+            uintptr_t expected = uintptr_t(succs[0]);
+            if (preds[0]->next()[0].compare_exchange_strong(expected, uintptr_t(n))) break;
+        }
+        // n is in the list from here on. Link the levels above, unless a
+        // remove has already started marking them.
+        bool removed = false;
+        for (int level = 1; level < height && !removed; level++) {
+            while (true) {
+                uintptr_t link = n->next()[level].load();
+                if (pointer(link) != succs[level] && !marked(link)) {
+                    n->next()[level].compare_exchange_strong(link, uintptr_t(succs[level]));
+                    link = n->next()[level].load();
+                }
+                if (marked(link)) {
+                    removed = true;
+                    break;
+                }
+                uintptr_t expected = uintptr_t(succs[level]);
+                if (preds[level]->next()[level].compare_exchange_strong(expected, uintptr_t(n))) break;
+                search(e, n->sequence, preds, succs);
+            }
+        }
+        // If a remove marked n while its levels were being linked, its own
+        // search may have run before the last link went in
+        if (marked(n->next()[0].load())) search(e, n->sequence, preds, succs);
+        release(n, g.slot);
+    }
+
+    void insert(Employee&& e) {
+        insert(static_cast<const Employee&>(e));
+    }
+
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        insert(Employee(std::forward<Args>(args)...));
+    }
+
+    // Removes the earliest inserted employee equal to e; false if there is none
+    bool remove(const Employee& e) {
+        guard g(*this);
+        node* preds[maxHeight];
+        node* succs[maxHeight];
+        for (node* n = search(e, 0, preds, succs); n != nullptr && n->employee == e; n = pointer(n->next()[0].load())) {
+            if (marked(n->next()[0].load())) continue;
+            for (int level = n->height - 1; level >= 1; level--) n->next()[level].fetch_or(1);
+            uintptr_t succ = n->next()[0].load();
+            while (!marked(succ)) {
+                if (n->next()[0].compare_exchange_weak(succ, succ | 1)) {
+                    search(e, n->sequence, preds, succs);    // unlinks n on every level
+                    release(n, g.slot);
+                    return true;
+                }
+            }
+            // Another thread removed this one first; look for the next equal employee
+        }
+        return false;
+    }
+
+    // Copies an employee earning salary into out, the first in the list's
+    // order; false if there is none
+    bool find(int salary, Employee& out) const {
+        guard g(*this);
+        for (node* n = lowerBound(salary); n != nullptr && n->employee.salary == salary; n = pointer(n->next()[0].load())) {
+            if (!marked(n->next()[0].load())) {
+                out = n->employee;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Number of employees earning exactly salary
+    size_t count(int salary) const {
+        size_t n = 0;
+        forEachInRange(salary, salary, [&n](const Employee&) { n++; });
+        return n;
+    }
+
+    vector<Employee> findAll(int salary) const {
+        return findInRange(salary, salary);
+    }
+
+    /* Calls visit(const Employee&) on every employee with a salary in
+    [min, max], in salary order. Each employee is seen if it was in the list
+    for the whole scan; ones inserted or removed while it runs may or may
+    not be. */
+    template<typename Visitor>
+    void forEachInRange(int min, int max, Visitor visit) const {
+        guard g(*this);
+        for (node* n = lowerBound(min); n != nullptr && n->employee.salary <= max; n = pointer(n->next()[0].load())) {
+            if (!marked(n->next()[0].load())) visit(n->employee);
+        }
+    }
+
+    template<typename OutputIt>
+    OutputIt copyInRange(int min, int max, OutputIt out) const {
+        forEachInRange(min, max, [&out](const Employee& e) { *out++ = e; });
+        return out;
+    }
+
+    vector<Employee> findInRange(int min, int max) const {
+        vector<Employee> out;
+        copyInRange(min, max, back_inserter(out));
+        return out;
+    }
+
+    void printInRange(int min, int max, ostream& os = cout) const {
+        forEachInRange(min, max, [&os](const Employee& e) { os << e << '\n'; });
+        os.flush();
+    }
+
+    void display() const {
+        printInRange(INT_MIN, INT_MAX);
+    }
+};
+
+/* The UI class contains functions relating to the UI of the
+application. They do not need to be wrapped in a class, but
+since they are logically associated, this groups them under
+the same namespace. */
+class UI {
+private:
+    EmployeeSkipList* employees = nullptr;
+
+    bool isBetween(int num, int* min, int* max) {
+        if (min != nullptr && num < *min) return false;
+        if (max != nullptr && num > *max) return false;
+        return true;
+    }
+
+    int inputInteger(int* min, int* max) {
+        int intput;
+        string input;
+        do {
+            cout << "  Input: ";      // prompt user for input
+            getline(cin, input);
+
+            try { intput = stoi(input); }
+            catch (const std::invalid_argument&) {
+                cout << "  Invalid input. Please enter a number between " << *min << " and " << *max << " (inclusive)." << endl;
+                continue;
+            }
+
+            if (isBetween(intput, min, max)) break;
+
+            cout << "  Invalid input. Please enter a number between " << *min << " and " << *max << " (inclusive)." << endl;
+        } while (true);                 // continue looping until input is valid
+        // input is valid, so return it
+        return intput;
+    }
+
+    Employee inputEmployee() {
+        int salary;
+        string firstName, lastName, jobTitle;
+        cout << "Enter a first name: " << endl;
+        getline(cin, firstName);
+        cout << "Enter a last name: " << endl;
+        getline(cin, lastName);
+        cout << "Enter a job title: " << endl;
+        getline(cin, jobTitle);
+        cout << "Enter a salary between 30000 and 200000." << endl;
+        int min = 30000;
+        int max = 200000;
+        salary = inputInteger(&min, &max);
+        return Employee(firstName, lastName, jobTitle, salary);
+    }
+
+public:
+    UI(EmployeeSkipList* list) : employees(list) {}
+
+    void mainMenu() {
+        cout << "----------------------------------" << endl;
+        cout << "What would you like to do?" << endl;
+        cout << "  1) Add an employee" << endl;
+        cout << "  2) Delete an employee" << endl;
+        cout << "  3) Search for employees" << endl;
+        cout << "  4) Quit" << endl;
+        cout << "----------------------------------" << endl;
+        int min = 1;
+        int max = 4;
+        switch (inputInteger(&min, &max))
+        {
+        case 1:
+            addEmployee();
+            break;
+        case 2:
+            deleteEmployee();
+            break;
+        case 3:
+            searchEmployee();
+            break;
+        case 4:
+            exit(0);
+        default:
+            throw runtime_error("How did we get here?!?!\n");
+            break;
+        }
+    }
+
+    void addEmployee() {
+        Employee e = inputEmployee();
+        employees->insert(e);
+        cout << "Successfully inserted " << e.firstName << " " << e.lastName << " into the database" << endl;
+    }
+
+    void deleteEmployee() {
+        int min = 30000;
+        int max = 200000;
+        cout << "Select a salary to search for." << endl;
+        int salary = inputInteger(&min, &max);
+        vector<Employee> v = employees->findAll(salary);
+        Employee z;
+        int n = v.size();
+        if (n == 0) {
+            cout << "No employees found with the given salary." << endl;
+            return;
+        }
+        else if (n == 1) {
+            z = v.at(0);
+        }
+        else {
+            // Display employees
+            cout << "Found " << n << " employees with salary $" << salary << ". Which would you like to delete?" << endl;
+            for (int i = 0; i < n; i++) {
+                cout << "  " << i + 1 << ") " << v.at(i) << endl;
+            }
+            // Get user input
+            min = 1;
+            z = v.at(inputInteger(&min, &n) - 1);
+        }
+        cout << "Delete " << z << "?" << endl;
+        cout << "  1) Yes" << endl;
+        cout << "  2) No" << endl;
+        min = 1;
+        max = 2;
+        if (inputInteger(&min, &max) == 1) {
+            if (employees->remove(z)) cout << "Deleted " << z << endl;
+            else cout << z << " was already deleted" << endl;
+        }
+        else {
+            cout << "Canceled" << endl;
+        }
+    }
+
+    void searchEmployee() {
+        cout << "Enter a minimum value." << endl;
+        int min = inputInteger(nullptr, nullptr);
+        cout << "Enter a maximum value." << endl;
+        int max = inputInteger(&min, nullptr);
+        employees->printInRange(min, max);
+    }
+};
+
+/* Non-interactive counterpart to UI, for scripts and for replaying a day
+of HR operations at full speed. Reads one tab-separated command per line
+and answers every command with tab-separated lines:
+
+    add <salary> <first> <last> <title>       ok
+    delete <salary> <first> <last> <title>    ok | missing
+    find <salary>                             found <n>, then n records
+    range <min> <max>                         found <n>, then n records
+
+Records are written as <salary> <first> <last> <title>. A malformed line
+is answered with "error <line number> <reason>"; blank lines and lines
+starting with # get no answer. Commands are read and answered in batches,
+with one write per batch instead of a flush per line. */
+class BatchUI {
+    EmployeeSkipList* employees = nullptr;
+    string out;                 // answers for the current batch
+    vector<string_view> fields; // fields of the current line
+    vector<Employee> matches;   // results of the current find or range query
+    size_t lineNumber = 0;
+
+    void split(string_view line) {
+        fields.clear();
+        size_t start = 0;
+        while (true) {
+            size_t tab = line.find('\t', start);
+            fields.push_back(line.substr(start, tab == string_view::npos ? string_view::npos : tab - start));
+            if (tab == string_view::npos) break;
+            start = tab + 1;
+        }
+    }
+
+    static bool parseInt(string_view s, int& value) {
+        auto result = from_chars(s.data(), s.data() + s.size(), value);
+        return result.ec == errc() && result.ptr == s.data() + s.size();
+    }
+
+    void appendInt(long long value) {
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, result.ptr);
+    }
+
+    void writeRecord(const Employee& e) {
+        appendInt(e.salary);
+        out += '\t';
+        out.append(e.firstName.view());
+        out += '\t';
+        out.append(e.lastName.view());
+        out += '\t';
+        out.append(e.jobTitle.view());
+        out += '\n';
+    }
+
+    void writeFound(size_t n) {
+        out.append("found\t");
+        appendInt((long long)n);
+        out += '\n';
+    }
+
+    void error(const char* reason) {
+        out.append("error\t");
+        appendInt((long long)lineNumber);
+        out += '\t';
+        out.append(reason);
+        out += '\n';
+    }
+
+    // Fields 1 to 4 as an employee; false if the salary is not a number
+    bool parseEmployee(Employee& e) {
+        int salary;
+        if (fields.size() != 5 || !parseInt(fields[1], salary)) return false;
+        e = Employee(fields[2], fields[3], fields[4], salary);
+        return true;
+    }
+
+    void execute(string_view line) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty() || line.front() == '#') return;
+        split(line);
+        string_view command = fields[0];
+        Employee e;
+        int min, max;
+        if (command == "add") {
+            if (!parseEmployee(e)) return error("usage: add <salary> <first> <last> <title>");
+            employees->insert(std::move(e));
+            out.append("ok\n");
+        }
+        else if (command == "delete") {
+            if (!parseEmployee(e)) return error("usage: delete <salary> <first> <last> <title>");
+            out.append(employees->remove(e) ? "ok\n" : "missing\n");
+        }
+        else if (command == "find") {
+            if (fields.size() != 2 || !parseInt(fields[1], min)) return error("usage: find <salary>");
+            matches.clear();
+            employees->copyInRange(min, min, back_inserter(matches));
+            writeFound(matches.size());
+            for (const Employee& f : matches) writeRecord(f);
+        }
+        else if (command == "range") {
+            if (fields.size() != 3 || !parseInt(fields[1], min) || !parseInt(fields[2], max)) {
+                return error("usage: range <min> <max>");
+            }
+            matches.clear();
+            employees->copyInRange(min, max, back_inserter(matches));
+            writeFound(matches.size());
+            for (const Employee& f : matches) writeRecord(f);
+        }
+        else {
+            error("unknown command");
+        }
+    }
+
+public:
+    static constexpr size_t batchSize = 4096;   // commands per write
+
+    BatchUI(EmployeeSkipList* list) : employees(list) {}
+
+    void run(istream& in, ostream& os) {
+        string line;
+        bool more = true;
+        while (more) {
+            out.clear();
+            for (size_t i = 0; i < batchSize; i++) {
+                if (!getline(in, line)) {
+                    more = false;
+                    break;
+                }
+                lineNumber++;
+                execute(line);
+            }
+            os.write(out.data(), (streamsize)out.size());
+        }
+        os.flush();
+    }
+};
+
+static string randStr(int length) {
+    // Define the list of possible characters
+    const string CHARACTERS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+    // Create a random number generator
+    random_device rd;
+    mt19937 generator(rd());
+
+    // Create a distribution to uniformly select from all
+    // characters
+    uniform_int_distribution<> distribution(0, CHARACTERS.size() - 1);
+
+    // Generate the random string
+    string random_string;
+    for (int i = 0; i < length; ++i) {
+        random_string += CHARACTERS[distribution(generator)];
+    }
+
+    return random_string;
+}
+
+/* Inserts 10,000 employees into the list, with random data
+and salaries ranging from 30,000 to 200,000.*/
+static void initializeDummyData(EmployeeSkipList& list) {
+    const string CHARACTERS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    random_device rd;
+    mt19937 gen(rd());
+
+    uniform_int_distribution<int> salaryDist(30'000, 200'000);
+
+    for (int i = 0; i < 10000; i++) {
+        list.emplace(randStr(8), randStr(8), randStr(8), salaryDist(gen));
+    }
+}
+
+/* Reproducible benchmarks for this engine. Workloads are generated from
+fixed seeds, so Employee_Info_BST, Employee_Info_RB_Tree and this skip list
+time exactly the same operations on exactly the same data and their
+reports can be compared row by row. Peak RSS is the high-water mark of the whole
+process, so run one size per process when comparing memory. */
+class Benchmark {
+public:
+    enum distribution { uniform, sorted, reverseSorted, duplicates };
+
+    static const char* name(distribution d) {
+        switch (d) {
+        case sorted: return "sorted";
+        case reverseSorted: return "reverse";
+        case duplicates: return "duplicates";
+        default: return "uniform";
+        }
+    }
+
+    /* n employees with salaries in [30000, 200000] drawn from d. The
+    duplicates distribution only uses 100 distinct salaries. Names come
+    from fixed pools so they repeat the way they do in a real roster. */
+    static vector<Employee> workload(size_t n, distribution d, unsigned seed = 42) {
+        mt19937 gen(seed);
+        vector<InternedString> firstNames = namePool(gen, 2'000);
+        vector<InternedString> lastNames = namePool(gen, 20'000);
+        vector<InternedString> titles = namePool(gen, 300);
+        uniform_int_distribution<int> salaryDist(30'000, 200'000);
+        uniform_int_distribution<int> bandDist(0, 99);
+
+        vector<Employee> roster;
+        roster.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            int salary = (d == duplicates) ? 30'000 + bandDist(gen) * 1'700 : salaryDist(gen);
+            roster.emplace_back(firstNames[gen() % firstNames.size()], lastNames[gen() % lastNames.size()],
+                titles[gen() % titles.size()], salary);
+        }
+        if (d == sorted) stable_sort(roster.begin(), roster.end());
+        if (d == reverseSorted) stable_sort(roster.begin(), roster.end(), greater<Employee>());
+        return roster;
+    }
+
+    // Largest resident set size the process has reached, in bytes
+    static size_t peakRss() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+        return counters.PeakWorkingSetSize;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+        return (size_t)usage.ru_maxrss;
+#else
+        return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+    }
+
+    /* Runs insert, find, findAll, range, remove and teardown for every size
+    and distribution and prints one row per operation. A case whose inserts
+    take longer than budgetSeconds (the unbalanced BST on sorted input) is
+    cut short and reported as such instead of running for hours. */
+    static void suite(const vector<size_t>& sizes, double budgetSeconds) {
+        cout << left << setw(12) << "engine" << setw(12) << "workload" << right << setw(10) << "employees"
+            << "  " << left << setw(9) << "operation" << right << setw(10) << "ops" << setw(12) << "ns/op"
+            << setw(14) << "ops/s" << setw(12) << "peak RSS MB" << '\n';
+        for (size_t n : sizes) {
+            for (distribution d : { uniform, sorted, reverseSorted, duplicates }) {
+                runCase(n, d, budgetSeconds);
+            }
+        }
+        cout.flush();
+    }
+
+    /* For each entry of threadCounts, splits count employees between that
+    many writer threads, which insert their share into one shared
+    EmployeeSkipList at the same time and then remove it again. No write
+    takes a lock, so throughput should grow with the writers up to the
+    number of cores. */
+    static void concurrentWrites(size_t count, const vector<unsigned>& threadCounts) {
+        vector<Employee> roster = workload(count, uniform);
+        cout << "Concurrent writes of " << count << " employees into one EmployeeSkipList\n";
+        cout << right << setw(10) << "writers" << setw(16) << "inserts/s" << setw(16) << "removes/s"
+            << setw(10) << "speedup" << '\n';
+        double single = 0;
+        for (unsigned threads : threadCounts) {
+            EmployeeSkipList tree;
+            auto run = [&](auto write) {
+                vector<thread> writers;
+                auto start = chrono::steady_clock::now();
+                for (unsigned t = 0; t < threads; t++) {
+                    writers.emplace_back([&, t] {
+                        for (size_t i = count * t / threads; i < count * (t + 1) / threads; i++) write(roster[i]);
+                    });
+                }
+                for (thread& w : writers) w.join();
+                return count / (elapsedNs(start) / 1e9);
+            };
+            auto stored = [&tree] {
+                size_t n = 0;
+                tree.forEachInRange(INT_MIN, INT_MAX, [&n](const Employee&) { n++; });
+                return n;
+            };
+
+            double inserts = run([&tree](const Employee& e) { tree.insert(e); });
+            size_t afterInserts = stored();
+            double removes = run([&tree](const Employee& e) { tree.remove(e); });
+            if (single == 0) single = inserts;
+            cout << setw(10) << threads << fixed << setprecision(0) << setw(16) << inserts << setw(16) << removes
+                << setprecision(2) << setw(10) << inserts / single << '\n';
+            if (afterInserts != count || stored() != 0) cout << "  (writes were lost)\n";
+        }
+        cout.flush();
+    }
+
+private:
+    static vector<InternedString> namePool(mt19937& gen, size_t count) {
+        const string CHARACTERS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+        vector<InternedString> pool;
+        pool.reserve(count);
+        string name(8, ' ');
+        for (size_t i = 0; i < count; i++) {
+            for (char& c : name) c = CHARACTERS[gen() % CHARACTERS.size()];
+            pool.emplace_back(name);
+        }
+        return pool;
+    }
+
+    // Salaries to look up, the same for every engine and workload
+    static vector<int> probes(size_t count) {
+        mt19937 gen(7);
+        uniform_int_distribution<int> salaryDist(30'000, 200'000);
+        vector<int> out(count);
+        for (int& p : out) p = salaryDist(gen);
+        return out;
+    }
+
+    static double elapsedNs(chrono::steady_clock::time_point start) {
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    }
+
+    static void report(distribution d, size_t n, const char* operation, size_t ops, double ns) {
+        double perOp = ops == 0 ? 0 : ns / ops;
+        cout << left << setw(12) << "SkipList" << setw(12) << name(d) << right << setw(10) << n
+            << "  " << left << setw(9) << operation << right << setw(10) << ops
+            << fixed << setprecision(1) << setw(12) << perOp
+            << setprecision(0) << setw(14) << (perOp == 0 ? 0 : 1e9 / perOp)
+            << setprecision(1) << setw(12) << peakRss() / (1024.0 * 1024.0) << '\n';
+    }
+
+    static void runCase(size_t n, distribution d, double budgetSeconds) {
+        vector<Employee> roster = workload(n, d);
+        vector<int> lookups = probes(min<size_t>(n, 1'000'000));
+        unique_ptr<EmployeeSkipList> tree = make_unique<EmployeeSkipList>();
+
+        auto start = chrono::steady_clock::now();
+        size_t inserted = 0;
+        for (const Employee& e : roster) {
+            tree->insert(e);
+            if (++inserted % 1024 == 0 && elapsedNs(start) > budgetSeconds * 1e9) break;
+        }
+        report(d, n, "insert", inserted, elapsedNs(start));
+        if (inserted < n) {
+            cout << "  insert exceeded the " << budgetSeconds << "s budget; skipping the rest of this case\n";
+            cout.flush();
+            return;
+        }
+
+        size_t hits = 0;
+        Employee found;
+        start = chrono::steady_clock::now();
+        for (int q : lookups) hits += tree->find(q, found);
+        report(d, n, "find", lookups.size(), elapsedNs(start));
+
+        start = chrono::steady_clock::now();
+        for (int q : lookups) hits += tree->count(q);
+        report(d, n, "findAll", lookups.size(), elapsedNs(start));
+
+        // Narrow salary bands of 1000, a tenth as many as the point lookups.
+        // Every match is read so the visit cannot be optimized away.
+        size_t bands = max<size_t>(1, lookups.size() / 10);
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < bands; i++) {
+            tree->forEachInRange(lookups[i], lookups[i] + 999, [&hits](const Employee& e) { hits += e.salary; });
+        }
+        report(d, n, "range", bands, elapsedNs(start));
+
+        vector<size_t> victims(n);
+        for (size_t i = 0; i < n; i++) victims[i] = i;
+        shuffle(victims.begin(), victims.end(), mt19937(11));
+        victims.resize(min<size_t>(n / 2, 100'000));    // leave the rest for teardown
+        start = chrono::steady_clock::now();
+        for (size_t i : victims) tree->remove(roster[i]);
+        report(d, n, "remove", victims.size(), elapsedNs(start));
+
+        start = chrono::steady_clock::now();
+        tree.reset();
+        report(d, n, "teardown", n - victims.size(), elapsedNs(start));
+        if (hits == 0) cout << "  (no lookups matched)\n";
+        cout.flush();
+    }
+};
+
+int main(int argc, char* argv[]) {
+    vector<string> args(argv + 1, argv + argc);
+    string mode = args.empty() ? "" : args[0];
+    if (mode == "--bench") {            // --bench [budget seconds] [employees...]
+        double budget = args.size() > 1 ? stod(args[1]) : 30;
+        vector<size_t> sizes;
+        for (size_t i = 2; i < args.size(); i++) sizes.push_back(stoul(args[i]));
+        if (sizes.empty()) sizes = { 10'000, 1'000'000, 10'000'000 };
+        Benchmark::suite(sizes, budget);
+        return 0;
+    }
+    if (mode == "--bench-writes") {     // --bench-writes [employees] [writer threads...]
+        vector<unsigned> threads;
+        for (size_t i = 2; i < args.size(); i++) threads.push_back(unsigned(stoul(args[i])));
+        if (threads.empty()) threads = { 1, 4, 16 };
+        Benchmark::concurrentWrites(args.size() > 1 ? stoul(args[1]) : 1'000'000, threads);
+        return 0;
+    }
+    if (mode == "--batch") {            // --batch [command file], stdin if omitted or -
+        ios::sync_with_stdio(false);
+        cin.tie(nullptr);
+        EmployeeSkipList list;
+        BatchUI batch(&list);
+        string path = args.size() > 1 ? args[1] : "-";
+        if (path == "-") {
+            batch.run(cin, cout);
+        }
+        else {
+            ifstream commands(path);
+            if (!commands) {
+                cerr << "Could not open " << path << endl;
+                return 1;
+            }
+            batch.run(commands, cout);
+        }
+        return 0;
+    }
+    EmployeeSkipList list;
+    UI ui = UI(&list);
+    cout << "~~~ Inserting Evan, Thor, and Jonah ~~~" << endl;
+    list.insert(Employee("evan", "whitmer", "frontend developer", 199999));
+    list.insert(Employee("jonah", "ebent", "retired", 200000));
+    list.insert(Employee("thor", "pilegaard", "code monkey", 199998));
+    list.display();
+    cout << endl;
+    cout << "~~~ Displaying all employees with salary in range [199999, 200000] ~~~" << endl;
+    list.printInRange(199999, 200000);
+    cout << endl;
+    cout << "~~~ Searching for the first employee with salary $199999 ~~~" << endl;
+    Employee found;
+    if (list.find(199999, found)) cout << found << endl;
+    cout << endl;
+    cout << "~~~ Removing jonah ~~~" << endl;
+    list.remove(Employee("jonah", "ebent", "retired", 200000));
+    list.display();
+    cout << endl;
+    initializeDummyData(list);
+    cout << "Welcome to the employee \"Database\"" << endl;
+    while (true) ui.mainMenu();
+    return 0;
+}